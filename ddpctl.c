@@ -4,88 +4,213 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "include/anim.h"
 #include "include/cli.h"
-#include "include/ddp.h"
+#include "include/clock.h"
+#include "include/daemon.h"
+#include "include/engine.h"
 #include "include/gif.h"
+#include "include/output.h"
+#include "include/pool.h"
+#include "include/probe.h"
+#include "include/show.h"
+#include "include/wall.h"
 
 #include "include/config.h"
 
 // global configuration for cli
-Config g_cfg = {.filename = NULL, .brightness = 0.5f, .loop_count = -1};
+Config g_cfg = {.filename = NULL,
+                .brightness = 0.5f,
+                .loop_count = -1,
+                .output = NULL,
+                .manifest = NULL,
+                .layout = NULL,
+                .wiring = NULL,
+                .socket = NULL,
+                .start_frame = 0,
+                .start_ms = 0,
+                .resume = NULL,
+                .record = NULL,
+                .replay = NULL,
+                .power_budget_ma = 0,
+                .channel_ma = LED_CHANNEL_MA,
+                .threads = 0,
+                .bench = 0,
+                .low_memory = 0,
+                .fps = 0,
+                .compress = 0,
+                .start_at_ns = 0,
+                .start_at = 0,
+                .sync_group = 0,
+                .format = PIXEL_RGB8,
+                .probe = 0,
+                .dither = 0};
+
+static void print_bench(uint64_t load_ns) {
+  int threads = g_cfg.threads > 0 ? g_cfg.threads : pool_default_threads();
+  fprintf(stderr, "load: %.1f ms (%d sampling thread%s%s%s)\n",
+          (double)load_ns / (double)NS_PER_MS, threads,
+          threads == 1 ? "" : "s", g_cfg.low_memory ? ", low-mem" : "",
+          g_cfg.compress ? ", compressed while sampling" : "");
+
+  // ru_maxrss is in KiB on linux
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) == 0)
+    fprintf(stderr, "peak rss: %.1f MiB\n", (double)ru.ru_maxrss / 1024.0);
+
+  anim_report(stderr);
+}
+
+// reports on -f as it would be loaded, without decoding it
+static int probe(void) {
+  struct extract_opts opts = {.brightness = g_cfg.brightness,
+                              .width = MATRIX_WIDTH,
+                              .height = MATRIX_HEIGHT,
+                              .fps = g_cfg.fps,
+                              .compress = g_cfg.compress,
+                              .format = g_cfg.dither ? PIXEL_RGB16
+                                                     : g_cfg.format};
+
+  // a wall is sampled at its full size. its controllers may leave parts
+  // of it undriven, so this overestimates a little.
+  if (g_cfg.layout) {
+    struct wall *w = wall_load(g_cfg.layout);
+    if (!w)
+      return -1;
+    opts.width = w->width;
+    opts.height = w->height;
+    wall_free(w);
+  }
+
+  return probe_gif(g_cfg.filename, &opts, stdout);
+}
+
+// runs the engine, recording what it sends if asked to
+static int run(struct engine *engine) {
+  struct show_writer *show = NULL;
+  if (g_cfg.record) {
+    show = show_open(g_cfg.record);
+    if (!show)
+      return -1;
+    sink_record(show);
+  }
+
+  int ret = engine_run(engine);
+
+  sink_record(NULL);
+  if (show_close(show) != 0)
+    ret = -1;
+  return ret;
+}
 
 int main(int argc, char **argv) {
 
   // parse cli
   parse_cli(argc, argv, &g_cfg);
 
+  // a show is already-built packets: no decode, no color work, no engine
+  if (g_cfg.replay)
+    return show_replay(g_cfg.replay, g_cfg.output, g_cfg.loop_count) == 0
+               ? 0
+               : 1;
+
   // precalculate gamma values
   init_gamma();
+  extract_set_threads(g_cfg.threads);
+  extract_set_low_memory(g_cfg.low_memory);
 
-  // create ddp header
-  struct ddp_header header;
-  header.flags = 0x41;
-  header.res1 = 0x0;
-  header.type = 0x03;
-  header.res2 = 0x0;
-  header.offset = 0x0;
-  header.length = NUM_LEDS * BYTES_PER_LED;
-
-  // only set header as it can be reused
-  struct DDP ddp;
-  ddp.header = header;
-
-  // load gif frames, delays in between, and frame count
-  uint8_t **frames = NULL;
-  size_t *delays_in_ms = NULL;
-
-  size_t frame_count = extract_gif_frames(g_cfg.filename, &frames,
-                                          &delays_in_ms, g_cfg.brightness);
-  if (frame_count == 0 || !frames || !delays_in_ms) {
-    fprintf(stderr, "failed to extract frames\n");
-    return 1;
-  }
-
-  size_t cur_frame_index = 0;
-  int loops_done = 0;
+  // only the file structure is read, nothing is decoded or sent
+  if (g_cfg.probe)
+    return probe() == 0 ? 0 : 1;
 
-  while (g_cfg.loop_count < 0 || loops_done < g_cfg.loop_count) {
-    // update only data
-    ddp.data = frames[cur_frame_index];
+  struct engine *engine = engine_create();
+  if (!engine)
+    return 1;
 
-    // serialize packet
-    size_t packet_size = 0;
-    uint8_t *serialized_packet = DDP_serialize(&ddp, &packet_size);
+  // the daemon is a player stream plus a control socket on the same loop
+  if (g_cfg.socket) {
+    struct daemon *d = daemon_start(engine, &g_cfg);
+    int ret = d ? run(engine) : -1;
+    daemon_stop(d);
+    engine_destroy(engine);
+    return ret == 0 ? 0 : 1;
+  }
 
-    if (!serialized_packet || packet_size == 0) {
-      fprintf(stderr, "failed to serialize ddp to packet\n");
-      free_frames_and_delays(frames, delays_in_ms, frame_count);
+  struct play_opts play = {.brightness = g_cfg.brightness,
+                           .loop_count = g_cfg.loop_count,
+                           .start_frame = g_cfg.start_frame,
+                           .start_ms = g_cfg.start_ms,
+                           .power = {.budget_ma = g_cfg.power_budget_ma,
+                                     .channel_ma = g_cfg.channel_ma,
+                                     .idle_ma = LED_IDLE_MA},
+                           .fps = g_cfg.fps,
+                           .compress = g_cfg.compress,
+                           .synced = g_cfg.start_at || g_cfg.sync_group,
+                           .epoch_ns = g_cfg.start_at_ns,
+                           .join_loops = g_cfg.sync_group,
+                           .format = g_cfg.format,
+                           .dither = g_cfg.dither};
+
+  // a checkpoint, if there is one, overrides --start-frame/--start-time.
+  // keyframes kept next to it let the next run seek without decoding
+  // everything before the checkpoint.
+  char seek_cache[PATH_MAX];
+  if (g_cfg.resume) {
+    if (engine_read_checkpoint(g_cfg.resume, &play) < 0 ||
+        snprintf(seek_cache, sizeof(seek_cache), "%s.seek", g_cfg.resume) >=
+            (int)sizeof(seek_cache)) {
+      engine_destroy(engine);
       return 1;
     }
+    play.seek_cache = seek_cache;
+  }
 
-    // write frame to stdout immediately
-    fwrite(serialized_packet, 1, packet_size, stdout);
-    fflush(stdout);
+  if (play.loop_count >= 0 && play.loops_done >= play.loop_count) {
+    fprintf(stderr, "checkpoint: all %d loops already played\n",
+            play.loop_count);
+    engine_destroy(engine);
+    return 0;
+  }
 
-    // delay before next frame
-    usleep(delays_in_ms[cur_frame_index] * 1000);
+  // a single -f is just a one-stream engine, so both modes share the
+  // same deadline clock and send path
+  uint64_t load_start = mono_ns();
+  int ret;
+  if (g_cfg.manifest)
+    ret = engine_add_manifest(engine, g_cfg.manifest, &play);
+  else if (g_cfg.layout)
+    ret = engine_add_wall(engine, g_cfg.filename, g_cfg.layout, &play);
+  else
+    ret = engine_add_stream(engine, g_cfg.filename, g_cfg.output, 0,
+                            g_cfg.wiring, &play);
+
+  if (ret != 0) {
+    fprintf(stderr, "failed to set up streams\n");
+    engine_destroy(engine);
+    return 1;
+  }
 
-    // move to next frame
-    cur_frame_index += 1;
+  // everything is decoded and sampled by now, nothing has been sent
+  if (g_cfg.bench) {
+    print_bench(mono_ns() - load_start);
+    engine_destroy(engine);
+    return 0;
+  }
 
-    // loop management
-    if (cur_frame_index == frame_count) {
-      cur_frame_index = 0;
-      loops_done += 1;
-    }
+  ret = run(engine);
 
-    // release
-    free(serialized_packet);
+  if (g_cfg.resume) {
+    if (engine_write_checkpoint(engine, g_cfg.resume) != 0)
+      ret = -1;
+    // the keyframes go with the checkpoint they were kept for
+    if (access(g_cfg.resume, F_OK) != 0)
+      unlink(seek_cache);
   }
 
-  // clean the other mess (maybe use valgrind?)
-  free_frames_and_delays(frames, delays_in_ms, frame_count);
-  return 0;
+  engine_destroy(engine);
+  return ret == 0 ? 0 : 1;
 }
@@ -0,0 +1,600 @@
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "include/clock.h"
+#include "include/config.h"
+#include "include/ddp.h"
+
+// ddpsink: a local stand-in for a DDP receiver. reads packets from udp or
+// a stdin pipe, reassembles frames by offset and PUSH, and reports frame
+// rate, inter-frame jitter, loss and reordering. listening on several
+// ports stands in for the controllers of a wall, and also reports how far
+// apart their PUSHes arrive.
+
+// largest frame reassembled, anything past it is counted as a bad packet
+#define MAX_FRAME_BYTES (1 << 22)
+
+// udp ports one sink listens on
+#define MAX_LISTEN 16
+
+typedef struct {
+  const char *listen[MAX_LISTEN]; // [host:]port each, none = stdin
+  size_t listen_count;
+  int render;        // draw frames as ANSI truecolor blocks
+  int width;         // LEDs per row when rendering
+  unsigned interval; // seconds between reports, 0 = summary only
+} SinkConfig;
+
+struct stats {
+  uint64_t start_ns;
+  uint64_t packets, bytes, frames;
+  uint64_t lost, reordered, incomplete, bad;
+
+  // inter-frame intervals, running mean and variance (welford)
+  uint64_t intervals;
+  double mean, m2;
+  uint64_t min, max;
+};
+
+// PUSH arrival spread across receivers, i.e. the skew between controllers
+// as seen on the wire. the k-th PUSH on every port is taken to latch the
+// same frame; a port pushing again before the others did means a PUSH
+// went missing, and that frame is counted as unmatched.
+struct skew {
+  uint64_t frames, unmatched;
+  uint64_t sum_ns, max_ns;
+};
+
+struct push_round {
+  size_t receivers; // how many receivers the sink has
+  size_t pushed;    // how many of them pushed this round
+  uint64_t first_ns, last_ns;
+  struct skew window, total;
+};
+
+struct frame {
+  uint8_t *buf;
+  size_t cap;
+  size_t end;     // highest byte written since the last PUSH
+  size_t covered; // payload bytes received since the last PUSH
+  uint8_t type;
+};
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int sig) {
+  (void)sig;
+  g_stop = 1;
+}
+
+static void stats_reset(struct stats *st, uint64_t now) {
+  memset(st, 0, sizeof(*st));
+  st->start_ns = now;
+  st->min = UINT64_MAX;
+}
+
+static void stats_interval(struct stats *st, uint64_t dt) {
+  st->intervals += 1;
+  double d = (double)dt - st->mean;
+  st->mean += d / (double)st->intervals;
+  st->m2 += d * ((double)dt - st->mean);
+  if (dt < st->min)
+    st->min = dt;
+  if (dt > st->max)
+    st->max = dt;
+}
+
+static void stats_print(const struct stats *st, uint64_t now,
+                        const char *label) {
+  double secs = (double)(now - st->start_ns) / (double)NS_PER_SEC;
+  if (secs <= 0.0)
+    secs = 1e-9;
+
+  double jitter =
+      st->intervals > 1 ? sqrt(st->m2 / (double)(st->intervals - 1)) : 0.0;
+
+  fprintf(stderr,
+          "%s%.1f fps  %.2f Mbit/s  interval %.2fms (%.2f-%.2f)"
+          "  jitter %.3fms  pkts %llu  lost %llu  reordered %llu"
+          "  incomplete %llu  bad %llu\x1b[K\n",
+          label, (double)st->frames / secs,
+          (double)st->bytes * 8.0 / secs / 1e6, st->mean / 1e6,
+          st->intervals ? (double)st->min / 1e6 : 0.0,
+          (double)st->max / 1e6, jitter / 1e6,
+          (unsigned long long)st->packets, (unsigned long long)st->lost,
+          (unsigned long long)st->reordered,
+          (unsigned long long)st->incomplete, (unsigned long long)st->bad);
+}
+
+// bytes per channel and channels per pixel from the DDP data type
+// (C R TTT SSS). type 0 is read as 8 bit RGB, like most receivers do.
+static void pixel_format(uint8_t type, int *channels, int *depth) {
+  *channels = ((type >> 3) & 0x7) == 3 ? 4 : 3;
+  *depth = (type & 0x7) == 4 ? 2 : 1;
+}
+
+static void render(const struct frame *f, int width) {
+  int channels, depth;
+  pixel_format(f->type, &channels, &depth);
+
+  size_t bpp = (size_t)(channels * depth);
+  size_t pixels = f->end / bpp;
+  size_t rows = (pixels + (size_t)width - 1) / (size_t)width;
+
+  // two LED rows per text row: upper half block, fg above and bg below
+  static char out[1 << 20];
+  size_t n = (size_t)snprintf(out, sizeof(out), "\x1b[H");
+
+  for (size_t y = 0; y < rows; y += 2) {
+    for (size_t x = 0; x < (size_t)width; x++) {
+      uint8_t rgb[2][3] = {{0}};
+      for (size_t h = 0; h < 2; h++) {
+        size_t i = (y + h) * (size_t)width + x;
+        if (y + h >= rows || i >= pixels)
+          continue;
+
+        // 16 bit channels are big-endian, the high byte is enough here
+        const uint8_t *p = f->buf + i * bpp;
+        int w = channels == 4 ? p[3 * depth] : 0;
+        for (int c = 0; c < 3; c++) {
+          int v = p[c * depth] + w;
+          rgb[h][c] = (uint8_t)(v > 255 ? 255 : v);
+        }
+      }
+
+      if (n + 64 >= sizeof(out))
+        break;
+      n += (size_t)snprintf(out + n, sizeof(out) - n,
+                            "\x1b[38;2;%d;%d;%dm\x1b[48;2;%d;%d;%dm▀",
+                            rgb[0][0], rgb[0][1], rgb[0][2], rgb[1][0],
+                            rgb[1][1], rgb[1][2]);
+    }
+    n += (size_t)snprintf(out + n, sizeof(out) - n, "\x1b[0m\n");
+  }
+
+  fwrite(out, 1, n, stdout);
+  fflush(stdout);
+}
+
+// sequence numbers run 1-15. a small step forward means packets went
+// missing; a big one means this packet is late, and was counted as lost
+// when the ones after it arrived.
+static void track_seq(int *last, int seq, struct stats *st) {
+  if (seq == 0)
+    return;
+
+  if (*last != 0) {
+    int d = (seq - *last + 15) % 15;
+    if (d == 0 || d >= 8) {
+      st->reordered += 1;
+      if (st->lost)
+        st->lost -= 1;
+      return;
+    }
+    st->lost += (uint64_t)(d - 1);
+  }
+
+  *last = seq;
+}
+
+struct receiver {
+  const SinkConfig *cfg;
+  const char *name; // listen address, for reports
+  struct frame frame;
+  struct stats window, total;
+  uint64_t last_frame_ns;
+  int last_seq;
+
+  struct push_round *round; // shared by all receivers, NULL with one
+  int pushed;               // this receiver's PUSH of the round is in
+};
+
+static void skew_add(struct skew *sk, uint64_t ns) {
+  sk->frames += 1;
+  sk->sum_ns += ns;
+  if (ns > sk->max_ns)
+    sk->max_ns = ns;
+}
+
+// ends the round once every receiver has pushed
+static void on_push(struct receiver *r, struct receiver *all, uint64_t now) {
+  struct push_round *pr = r->round;
+
+  if (r->pushed) {
+    // another port never pushed for the last frame: start over from here
+    pr->window.unmatched += 1;
+    pr->total.unmatched += 1;
+    for (size_t i = 0; i < pr->receivers; i++)
+      all[i].pushed = 0;
+    pr->pushed = 0;
+  }
+
+  if (pr->pushed == 0)
+    pr->first_ns = now;
+  pr->last_ns = now;
+  r->pushed = 1;
+  pr->pushed += 1;
+
+  if (pr->pushed == pr->receivers) {
+    skew_add(&pr->window, pr->last_ns - pr->first_ns);
+    skew_add(&pr->total, pr->last_ns - pr->first_ns);
+    for (size_t i = 0; i < pr->receivers; i++)
+      all[i].pushed = 0;
+    pr->pushed = 0;
+  }
+}
+
+static void skew_print(const struct skew *sk, const char *label) {
+  fprintf(stderr,
+          "%sskew avg %.3fms  max %.3fms  frames %llu  unmatched %llu"
+          "\x1b[K\n",
+          label,
+          sk->frames ? (double)sk->sum_ns / (double)sk->frames / 1e6 : 0.0,
+          (double)sk->max_ns / 1e6, (unsigned long long)sk->frames,
+          (unsigned long long)sk->unmatched);
+}
+
+// all is every receiver of the sink, r among them
+static void on_packet(struct receiver *r, struct receiver *all,
+                      const uint8_t *pkt, size_t len, uint64_t now) {
+  struct stats *sts[2] = {&r->window, &r->total};
+
+  struct ddp_header h;
+  int hlen = ddp_header_parse(pkt, len, &h);
+  if (hlen < 0 || (size_t)hlen + h.length > len ||
+      (size_t)h.offset + h.length > MAX_FRAME_BYTES) {
+    for (int i = 0; i < 2; i++)
+      sts[i]->bad += 1;
+    return;
+  }
+
+  // rates count from the first packet, not from startup
+  if (r->total.packets == 0)
+    r->total.start_ns = r->window.start_ns = now;
+
+  for (int i = 0; i < 2; i++) {
+    sts[i]->packets += 1;
+    sts[i]->bytes += len;
+  }
+  // loss and reordering are counted per window, report() adds them up
+  track_seq(&r->last_seq, h.res1 & DDP_SEQ_MASK, &r->window);
+
+  struct frame *f = &r->frame;
+  if (h.length > 0) {
+    size_t end = (size_t)h.offset + h.length;
+    if (end > f->cap) {
+      uint8_t *buf = (uint8_t *)realloc(f->buf, end);
+      if (!buf) {
+        for (int i = 0; i < 2; i++)
+          sts[i]->bad += 1;
+        return;
+      }
+      memset(buf + f->cap, 0, end - f->cap);
+      f->buf = buf;
+      f->cap = end;
+    }
+
+    memcpy(f->buf + h.offset, pkt + hlen, h.length);
+    f->covered += h.length;
+    if (end > f->end)
+      f->end = end;
+    f->type = h.type;
+  }
+
+  if (!(h.flags & DDP_FLAG_PUSH))
+    return;
+
+  for (int i = 0; i < 2; i++) {
+    sts[i]->frames += 1;
+    if (f->covered < f->end)
+      sts[i]->incomplete += 1;
+    if (r->last_frame_ns)
+      stats_interval(sts[i], now - r->last_frame_ns);
+  }
+  r->last_frame_ns = now;
+  if (r->round)
+    on_push(r, all, now);
+
+  if (r->cfg->render && f->end > 0)
+    render(f, r->cfg->width);
+
+  f->covered = 0;
+  f->end = 0;
+}
+
+// folds the window's sequence counters into the totals and starts a new
+// window
+static void report(struct receiver *r, uint64_t now, const char *label) {
+  r->total.lost += r->window.lost;
+  r->total.reordered += r->window.reordered;
+  if (label)
+    stats_print(&r->window, now, label);
+  stats_reset(&r->window, now);
+}
+
+// a window's report for every receiver, each line labelled with its
+// address when there are several, then their skew
+static void report_all(struct receiver *rs, size_t count, uint64_t now,
+                       int print) {
+  char label[300];
+  for (size_t i = 0; i < count; i++) {
+    snprintf(label, sizeof(label), "%s%s", count > 1 ? rs[i].name : "",
+             count > 1 ? ": " : "");
+    report(&rs[i], now, print ? label : NULL);
+  }
+
+  struct push_round *pr = rs[0].round;
+  if (pr) {
+    if (print)
+      skew_print(&pr->window, "");
+    memset(&pr->window, 0, sizeof(pr->window));
+  }
+}
+
+static int open_udp(const char *spec) {
+  char host[256] = "";
+  const char *port = spec;
+
+  const char *colon = strrchr(spec, ':');
+  if (colon) {
+    size_t n = (size_t)(colon - spec);
+    if (n >= sizeof(host)) {
+      fprintf(stderr, "host too long: %s\n", spec);
+      return -1;
+    }
+    memcpy(host, spec, n);
+    host[n] = '\0';
+    port = colon + 1;
+  }
+
+  struct addrinfo hints = {0};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  hints.ai_flags = AI_PASSIVE;
+
+  struct addrinfo *res = NULL;
+  int err = getaddrinfo(host[0] ? host : NULL, port, &hints, &res);
+  if (err != 0) {
+    fprintf(stderr, "failed to resolve %s: %s\n", spec, gai_strerror(err));
+    return -1;
+  }
+
+  int fd = -1;
+  for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+
+  if (fd < 0) {
+    fprintf(stderr, "failed to listen on %s: %s\n", spec, strerror(errno));
+    return -1;
+  }
+
+  // bursts from a wall or a manifest should not be lost in the socket
+  // buffer and show up as sender loss
+  int rcvbuf = 4 << 20;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  return fd;
+}
+
+// fds[i] feeds rs[i]
+static void run_udp(struct receiver *rs, const int *fds, size_t count) {
+  static uint8_t pkt[65536];
+  uint64_t interval = (uint64_t)rs[0].cfg->interval * NS_PER_SEC;
+  uint64_t next_report = mono_ns() + interval;
+
+  struct pollfd pfds[MAX_LISTEN];
+  for (size_t i = 0; i < count; i++)
+    pfds[i] = (struct pollfd){.fd = fds[i], .events = POLLIN};
+
+  while (!g_stop) {
+    int timeout = -1;
+    if (interval) {
+      uint64_t now = mono_ns();
+      if (now >= next_report) {
+        report_all(rs, count, now, 1);
+        next_report += interval;
+        continue;
+      }
+      timeout = (int)((next_report - now + NS_PER_MS - 1) / NS_PER_MS);
+    }
+
+    if (poll(pfds, (nfds_t)count, timeout) <= 0)
+      continue;
+
+    // arrival is stamped per packet, so skew isn't hidden by the order
+    // the fds are read in
+    for (size_t i = 0; i < count; i++) {
+      if (!(pfds[i].revents & POLLIN))
+        continue;
+      ssize_t n = recv(fds[i], pkt, sizeof(pkt), 0);
+      if (n < 0)
+        continue;
+      on_packet(&rs[i], rs, pkt, (size_t)n, mono_ns());
+    }
+  }
+}
+
+// reads exactly len bytes. returns 1, 0 on clean EOF, -1 on error.
+static int read_full(int fd, uint8_t *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = read(fd, buf + done, len - done);
+    if (n == 0)
+      return done == 0 ? 0 : -1;
+    if (n < 0) {
+      if (errno == EINTR && !g_stop)
+        continue;
+      return -1;
+    }
+    done += (size_t)n;
+  }
+  return 1;
+}
+
+// a pipe has no datagram boundaries, so each packet is cut out of the
+// byte stream by its header's length
+static void run_stdin(struct receiver *r) {
+  static uint8_t pkt[DDP_HEADER_SIZE + 4 + UINT16_MAX];
+  uint64_t interval = (uint64_t)r->cfg->interval * NS_PER_SEC;
+  uint64_t next_report = mono_ns() + interval;
+
+  while (!g_stop) {
+    if (read_full(STDIN_FILENO, pkt, DDP_HEADER_SIZE) <= 0)
+      break;
+
+    struct ddp_header h;
+    size_t hlen = DDP_HEADER_SIZE + (pkt[0] & DDP_FLAG_TIME ? 4 : 0);
+    if (ddp_header_parse(pkt, hlen, &h) < 0) {
+      fprintf(stderr, "stdin is not a DDP stream\n");
+      break;
+    }
+    if (read_full(STDIN_FILENO, pkt + DDP_HEADER_SIZE,
+                  hlen - DDP_HEADER_SIZE + h.length) < 0)
+      break;
+
+    uint64_t now = mono_ns();
+    on_packet(r, r, pkt, hlen + h.length, now);
+
+    // no poll here: reports go out as packets arrive
+    if (r->cfg->interval && now >= next_report) {
+      report_all(r, 1, now, 1);
+      next_report = now + interval;
+    }
+  }
+}
+
+static void parse_args(int argc, char **argv, SinkConfig *cfg) {
+  int opt;
+  while ((opt = getopt(argc, argv, "u:rW:i:h")) != -1) {
+    switch (opt) {
+
+    case 'u':
+      if (cfg->listen_count == MAX_LISTEN) {
+        fprintf(stderr, "at most %d -u\n", MAX_LISTEN);
+        exit(1);
+      }
+      cfg->listen[cfg->listen_count++] = optarg;
+      break;
+
+    case 'r':
+      cfg->render = 1;
+      break;
+
+    case 'W':
+    case 'i': {
+      char *end;
+      errno = 0;
+      long v = strtol(optarg, &end, 10);
+      if (errno || end == optarg || *end != '\0' || v < 0 || v > 65535 ||
+          (opt == 'W' && v == 0)) {
+        fprintf(stderr, "invalid -%c: %s\n", opt, optarg);
+        exit(1);
+      }
+      if (opt == 'W')
+        cfg->width = (int)v;
+      else
+        cfg->interval = (unsigned)v;
+      break;
+    }
+
+    case 'h':
+    default:
+      fprintf(stderr,
+              "usage: %s [-u [host:]port] [-r] [-W <width>] [-i <secs>]\n"
+              "  -u <addr>   listen for udp (default: read a stdin pipe).\n"
+              "              repeat for a wall's controllers, to also"
+              " report the\n"
+              "              spread of their PUSH arrivals\n"
+              "  -r          render frames as ANSI truecolor blocks\n"
+              "  -W <n>      LEDs per row when rendering (default %d)\n"
+              "  -i <secs>   report interval, 0 = summary only (default 1)\n",
+              argv[0], MATRIX_WIDTH);
+      exit(opt == 'h' ? 0 : 1);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  SinkConfig cfg = {.listen_count = 0,
+                    .render = 0,
+                    .width = MATRIX_WIDTH,
+                    .interval = 1};
+  parse_args(argc, argv, &cfg);
+
+  // no SA_RESTART, so a blocked read or poll returns and the summary
+  // still gets printed
+  struct sigaction sa = {0};
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  // stdin is a single receiver
+  size_t count = cfg.listen_count ? cfg.listen_count : 1;
+  struct receiver rs[MAX_LISTEN] = {0};
+  struct push_round round = {.receivers = count};
+  uint64_t now = mono_ns();
+  for (size_t i = 0; i < count; i++) {
+    rs[i].cfg = &cfg;
+    rs[i].name = cfg.listen_count ? cfg.listen[i] : "stdin";
+    rs[i].round = count > 1 ? &round : NULL;
+    stats_reset(&rs[i].window, now);
+    stats_reset(&rs[i].total, now);
+  }
+
+  if (cfg.render)
+    printf("\x1b[2J");
+
+  int ret = 0;
+  if (cfg.listen_count) {
+    int fds[MAX_LISTEN];
+    size_t opened = 0;
+    for (; opened < count; opened++) {
+      fds[opened] = open_udp(cfg.listen[opened]);
+      if (fds[opened] < 0)
+        break;
+    }
+    if (opened == count)
+      run_udp(rs, fds, count);
+    else
+      ret = 1;
+    for (size_t i = 0; i < opened; i++)
+      close(fds[i]);
+  } else {
+    run_stdin(&rs[0]);
+  }
+
+  if (ret == 0) {
+    now = mono_ns();
+    report_all(rs, count, now, 0);
+    char label[300];
+    for (size_t i = 0; i < count; i++) {
+      snprintf(label, sizeof(label), "%s%stotal: ",
+               count > 1 ? rs[i].name : "", count > 1 ? " " : "");
+      stats_print(&rs[i].total, now, label);
+    }
+    if (count > 1)
+      skew_print(&round.total, "total: ");
+  }
+
+  for (size_t i = 0; i < count; i++)
+    free(rs[i].frame.buf);
+  return ret;
+}
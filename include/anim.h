@@ -0,0 +1,69 @@
+#ifndef ANIM_H
+#define ANIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "framestore.h"
+#include "gif.h"
+
+// a decoded animation. streams playing the same file with the same
+// extraction options share one instance, so frames are decoded and stored
+// once.
+struct anim {
+  dev_t dev; // identity of the source file
+  ino_t ino;
+
+  // how the frames were sampled; opts.map is owned. opts.first_frame is
+  // the source frame that frames[0] holds.
+  struct extract_opts opts;
+  uint32_t *map;
+  size_t led_count;
+
+  uint8_t **frames;
+  size_t *delays_in_ms;
+  size_t frame_count;
+  size_t frame_size; // bytes per frame
+
+  // resampled animations (opts.fps) share frame buffers; they all live in
+  // store. NULL when every frame is its own allocation.
+  uint8_t *store;
+
+  // compressed animations (opts.compress) keep their frames here instead,
+  // and frames is NULL. read them with anim_frame().
+  struct frame_store *packed;
+
+  // each frame's channel sums, see anim_sum_channels(). NULL until then.
+  uint64_t (*channel_sums)[4];
+
+  int refs;
+  struct anim *next;
+};
+
+// returns a cached animation or decodes it as opts say (opts.map is
+// copied). NULL on failure.
+struct anim *anim_acquire(const char *path, const struct extract_opts *opts);
+
+// decodes an animation without going through the shared cache. touches no
+// shared state, so it is safe to call from a worker thread.
+struct anim *anim_load(const char *path, const struct extract_opts *opts);
+
+// drops a reference from either of the above
+void anim_release(struct anim *a);
+
+// sums every frame's channels once (see power.h), so a player can check
+// its power budget at send time without summing the frame. -1 on
+// allocation failure.
+int anim_sum_channels(struct anim *a);
+
+// frame i, decoded into c's buffer if the animation is compressed. NULL
+// if that buffer cannot be allocated.
+const uint8_t *anim_frame(const struct anim *a, size_t i,
+                          struct frame_cursor *c);
+
+// frame counts, memory and decode cost of every cached animation
+void anim_report(FILE *fp);
+
+#endif // ANIM_H
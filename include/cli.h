@@ -1,10 +1,38 @@
 #ifndef CLI_H
 #define CLI_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pixel.h"
+
 typedef struct {
   const char *filename; // file path
   float brightness;     // [0.0, 1.0]
   int loop_count;       // -1 = infinite
+  const char *output;   // sink spec, NULL = stdout
+  const char *manifest; // multi-stream manifest, replaces -f/-o
+  const char *layout;   // wall layout, fans -f out to several controllers
+  const char *wiring;   // LED wiring spec of the panel, NULL = row-major
+  const char *socket;   // daemon mode control socket
+  size_t start_frame;   // first frame to play
+  size_t start_ms;      // start time into the animation, wins over frame
+  const char *resume;   // checkpoint file to resume from and update
+  const char *record;   // show file every sent packet is copied to
+  const char *replay;   // show file to play instead of GIFs
+  uint32_t power_budget_ma; // PSU budget per frame, 0 = no limit
+  uint32_t channel_ma;      // draw of one channel at full duty
+  int threads;              // sampling threads, 0 = one per CPU
+  int bench;                // load, report timings and exit
+  int low_memory;           // decode only the sampled pixels
+  unsigned fps;             // resample to a fixed rate, 0 = gif timing
+  int compress;             // keep frames compressed in memory
+  int64_t start_at_ns;      // shared wall-clock epoch, ns since 1970
+  int start_at;             // start_at_ns was given
+  int sync_group;           // phase-lock to the wall clock, loops from join
+  enum pixel_format format; // what is sent for each LED
+  int probe;                // print what -f holds as JSON and exit
+  int dither;               // Hz to dither 16 bit frames at, 0 = off
 } Config;
 
 void parse_cli(int argc, char **argv, Config *cfg);
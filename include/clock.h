@@ -0,0 +1,32 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+#define NS_PER_MS 1000000ULL
+#define NS_PER_SEC 1000000000ULL
+
+// monotonic time in nanoseconds, the clock all frame deadlines use
+static inline uint64_t mono_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+// wall-clock time in ns since the unix epoch. unlike mono_ns it is the
+// same on every host with synced clocks.
+static inline int64_t real_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec * (int64_t)NS_PER_SEC + ts.tv_nsec;
+}
+
+// maps a wall-clock instant onto the monotonic clock, as of now. instants
+// before boot come out negative, hence signed.
+static inline int64_t realtime_to_mono_ns(int64_t real) {
+  int64_t mono = (int64_t)mono_ns();
+  return mono + (real - real_ns());
+}
+
+#endif // CLOCK_H
@@ -5,8 +5,8 @@
 #define MATRIX_WIDTH 16
 #define MATRIX_HEIGHT 16
 
-// WARN: don't change these values
-#define BYTES_PER_LED 3
+// LEDs on the matrix. bytes per LED depend on the pixel format, see
+// pixel_size() in pixel.h.
 #define NUM_LEDS (MATRIX_WIDTH * MATRIX_HEIGHT)
 
 // gamma correction per channel. tune these values according to
@@ -23,4 +23,25 @@
 // config
 #define MIN_DELAY_IN_MS 16
 
+// current draw for the power limiter (-P). a WS2812-style LED pulls about
+// 20mA per channel at full duty, and around 1mA while dark.
+#define LED_CHANNEL_MA 20
+#define LED_IDLE_MA 1
+
+// a canvas snapshot every this many frames bounds how much a seek decodes
+#define SEEK_KEYFRAME_INTERVAL 32
+
+// compressed frames (--compress) store a key frame at least this often,
+// bounding how many frames a jump decodes
+#define FRAME_STORE_KEY_INTERVAL 64
+
+// how often --dither resends the frame showing, each time against the
+// next phase (pixel.h), unless --dither-hz says otherwise. a full cycle
+// of DITHER_PHASES packets then takes 1/30 s.
+#define DITHER_DEFAULT_HZ 240
+
+// synced playback (--start-at, --sync-group) re-reads the wall clock once
+// a loop and rejoins the shared timeline if it moved by more than this
+#define SYNC_MAX_SLIP_MS 2
+
 #endif // CONFIG_H
@@ -0,0 +1,26 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "cli.h"
+#include "engine.h"
+
+// daemon mode: a player stream controlled over a unix-domain socket.
+// clients send one command per line and get one reply line back:
+//
+//   load <name> <gif>   decode into the cache in the background
+//   play <name>         switch at the next frame boundary
+//   queue <name>        play after the current animation's loop
+//   stop                blank the panel and go idle
+//   brightness <0-1>    applied from the next frame
+//   stats               one line of player and cache state
+//   unload <name>       drop from the cache
+struct daemon;
+
+// opens the socket and hooks the player and the socket into e. the
+// caller then drives everything with engine_run().
+struct daemon *daemon_start(struct engine *e, const Config *cfg);
+
+// waits for background loads and removes the socket
+void daemon_stop(struct daemon *d);
+
+#endif // DAEMON_H
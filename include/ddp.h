@@ -7,11 +7,31 @@
 // for all my needs, 10 bytes header is enough
 #define DDP_HEADER_SIZE 10
 
+// largest payload a single packet carries; bigger frames are fragmented
+// by offset. 1440 is a multiple of every supported pixel size.
+#define DDP_MAX_DATA 1440
+
+// header flags
+#define DDP_FLAG_VER1 0x40
+#define DDP_FLAG_PUSH 0x01
+#define DDP_FLAG_TIME 0x10 // a 4 byte timecode follows the header
+
+// the version bits of flags, and the low nibble of res1 that carries the
+// sequence number (1-15, 0 = unused)
+#define DDP_VER_MASK 0xC0
+#define DDP_SEQ_MASK 0x0F
+
+// data types, C R TTT SSS: TTT 1 = RGB, 3 = RGBW; SSS 3 = 8 bit, 4 = 16
+// bit. 0x03 leaves TTT undefined, which receivers take as RGB.
+#define DDP_TYPE_RGB8 0x03
+#define DDP_TYPE_RGBW8 0x1B
+#define DDP_TYPE_RGB16 0x0C
+
 // header structure of a DDP packet
 struct ddp_header {
   uint8_t flags;   // 0x41
-  uint8_t res1;    // 0x0
-  uint8_t type;    // 0x03 for RGB
+  uint8_t res1;    // low nibble: sequence number
+  uint8_t type;    // DDP_TYPE_*
   uint8_t res2;    // 0x0
   uint32_t offset; // 0x0
   uint16_t length; // no of data bytes
@@ -21,6 +41,14 @@ typedef uint8_t *ddp_data;
 
 uint8_t *ddp_header_serialize(const struct ddp_header *header);
 
+// writes the 10 byte wire header into buf (no allocation)
+void ddp_header_write(const struct ddp_header *header, uint8_t *buf);
+
+// reads a wire header from a packet of len bytes. returns the number of
+// bytes before the payload, or -1 if this is not a DDP v1 packet.
+int ddp_header_parse(const uint8_t *buf, size_t len,
+                     struct ddp_header *header);
+
 // DDP packet
 struct DDP {
   struct ddp_header header;
@@ -0,0 +1,134 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pixel.h"
+#include "power.h"
+
+// single-threaded event loop driving any number of animation streams.
+// each stream plays one animation to one or more outputs; all frame
+// deadlines live in a min-heap behind a single timerfd, and streams
+// playing the same file share decoded frames.
+struct engine;
+struct stream;
+struct anim;
+
+// how a stream plays
+struct play_opts {
+  float brightness;
+  int loop_count; // -1 = infinite
+
+  // where playback begins. with a single loop left to play, frames
+  // before the start are skipped at decode time; otherwise all frames are
+  // loaded and playback just begins there.
+  size_t start_frame;
+  size_t start_ms; // wins over start_frame when nonzero
+  int loops_done;  // loops already played, when resuming
+  const char *seek_cache; // keyframes kept between runs, see gif.h
+
+  struct power_opts power;  // per frame current limit
+  unsigned fps;             // fixed output rate, 0 = gif timing. start
+                            // frames then count output frames.
+  int compress;             // keep frames compressed in memory
+  enum pixel_format format; // what is sent for each LED
+  int dither;               // Hz to resend rgb16 frames at as dithered
+                            // rgb (see pixel.h), 0 = off
+
+  // synced playback: frame k of loop n is due at epoch + n * period +
+  // (start of frame k), on the wall clock, so instances sharing an epoch
+  // show the same frame at the same instant however long they took to
+  // load. late starters join at the frame due now.
+  int synced;
+  int64_t epoch_ns; // CLOCK_REALTIME ns since the unix epoch
+  int join_loops;   // count loops from joining rather than from the epoch
+};
+
+// called from the event loop when a watched fd is readable
+typedef void (*engine_fd_cb)(struct engine *e, int fd, void *ctx);
+
+struct engine *engine_create(void);
+
+// layout is the panel's wiring spec (see layout.h), NULL = row-major.
+// returns 0 on success, -1 if the gif or output could not be opened
+int engine_add_stream(struct engine *e, const char *gif, const char *output,
+                      uint32_t offset, const char *layout,
+                      const struct play_opts *play);
+
+// adds one stream per manifest line: "<gif> [output] [offset] [layout]".
+// blank lines and lines starting with '#' are ignored.
+int engine_add_manifest(struct engine *e, const char *path,
+                        const struct play_opts *play);
+
+// adds one stream sampled at the full wall resolution of a layout file
+// (see wall.h) and fanned out to every controller in it from a single
+// deadline. PUSH is sent to all controllers only after every controller
+// has its data, so the segments latch together.
+int engine_add_wall(struct engine *e, const char *gif, const char *layout,
+                    const struct play_opts *play);
+
+// runs until every stream has played its loops or SIGINT/SIGTERM
+// arrives. returns 0 on success.
+int engine_run(struct engine *e);
+
+void engine_destroy(struct engine *e);
+
+// checkpoints hold "<frame> <loops done>" of the first stream added that
+// is still playing. reading fills play's start position; returns 1 if one
+// was read, 0 if there is none yet, -1 on error. writing removes the file
+// once nothing is left.
+int engine_read_checkpoint(const char *path, struct play_opts *play);
+
+int engine_write_checkpoint(const struct engine *e, const char *path);
+
+// services fd from the event loop. while anything is watched, engine_run
+// keeps going even with no stream playing. returns 0 or -1.
+int engine_watch(struct engine *e, int fd, engine_fd_cb cb, void *ctx);
+
+void engine_unwatch(struct engine *e, int fd);
+
+// while on, a watched fd is also serviced when it is writable, e.g. a
+// socket with output queued. returns 0 or -1.
+int engine_watch_writable(struct engine *e, int fd, int on);
+
+// a player is a stream that is told what to play (daemon mode). it starts
+// idle and stays alive across animations; dither is as in play_opts. all
+// player_* calls only record the request; it takes effect at the player's
+// next frame boundary, so they never block the send loop.
+struct stream *engine_add_player(struct engine *e, const char *output,
+                                 uint32_t offset, enum pixel_format format,
+                                 int dither);
+
+// switches to a, looping it until something else is played or queued.
+// a's frames must match the player's LED count and format. takes its own
+// reference.
+void player_play(struct engine *e, struct stream *s, struct anim *a);
+
+// plays a after the current animation finishes its loop
+int player_queue(struct engine *e, struct stream *s, struct anim *a);
+
+// blanks the panel, clears the queue and goes idle
+void player_stop(struct stream *s);
+
+// brightness on top of the decoded frames, in [0, 1]
+void player_set_brightness(struct stream *s, float br);
+
+// power budget of what the player sends, i.e. after brightness. frames
+// given to a player should be loaded without one.
+void player_set_power(struct stream *s, const struct power_opts *p);
+
+struct player_stats {
+  const struct anim *anim; // NULL when idle
+  size_t frame;
+  int loops;
+  size_t queued;
+  uint64_t frames_sent;
+  uint64_t late_frames;
+  uint64_t limited_frames; // sent scaled down to the power budget
+  float brightness;
+};
+
+void player_get_stats(const struct stream *s, struct player_stats *st);
+
+#endif // ENGINE_H
@@ -0,0 +1,65 @@
+#ifndef FRAMESTORE_H
+#define FRAMESTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// compressed frames. each frame is stored run-length encoded either as
+// is (a key) or XORed with the frame before it (a delta), whichever is
+// smaller. runs are counted in whole pixels of `unit` bytes.
+//
+// an encoded frame is a series of packets, each a control byte c then:
+//   c < 0x80    c + 1 literal pixels
+//   c >= 0x80   one pixel, repeated (c & 0x7f) + 1 times
+struct frame_store {
+  size_t frame_count;
+  size_t frame_size;
+  size_t unit;
+
+  uint8_t *data;    // every encoded frame, back to back
+  size_t *offsets;  // frame_count + 1 entries into data
+  uint8_t *is_key;  // frame decodes without the one before it
+  size_t key_interval;
+
+  // while frames are appended: the last one as it was, for the next
+  // delta, and room to encode into
+  uint8_t *prev;
+  uint8_t *work;
+  size_t data_cap;
+  size_t frame_cap;
+};
+
+// starts an empty store. every key_interval-th frame is a key, so a seek
+// decodes at most key_interval frames. returns 0 or -1.
+int frame_store_init(struct frame_store *fs, size_t frame_size, size_t unit,
+                     size_t key_interval);
+
+// encodes frame after the ones before it, so a caller producing frames in
+// order never needs to hold more than one. returns 0 or -1.
+int frame_store_append(struct frame_store *fs, const uint8_t *frame);
+
+// trims the store once every frame is in and frees what appending needed
+void frame_store_finish(struct frame_store *fs);
+
+void frame_store_free(struct frame_store *fs);
+
+// bytes the encoded frames take, for reports
+size_t frame_store_bytes(const struct frame_store *fs);
+
+// where a stream decodes frames: buf holds frame index, ready to send
+struct frame_cursor {
+  uint8_t *buf;
+  size_t cap;
+  const struct frame_store *fs;
+  size_t index;
+};
+
+// frame i of fs, decoded into the cursor's buffer. the next frame of a
+// sequential walk costs one delta; anything else decodes from the last
+// key. NULL if the buffer cannot be allocated.
+const uint8_t *frame_cursor_get(struct frame_cursor *c,
+                                const struct frame_store *fs, size_t i);
+
+void frame_cursor_free(struct frame_cursor *c);
+
+#endif // FRAMESTORE_H
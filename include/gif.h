@@ -4,6 +4,9 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include "framestore.h"
+#include "power.h"
+
 // precalculate gamma values for each channel
 void init_gamma(void);
 
@@ -15,8 +18,77 @@ static inline uint8_t clamp_u8(int x) {
   return (uint8_t)x;
 }
 
+// how extract_gif_frames() samples a gif
+struct extract_opts {
+  float brightness;
+  int width; // LED grid
+  int height;
+  const uint32_t *map; // wire order of the LEDs (see layout.h), NULL =
+  size_t led_count;    // the whole grid, row-major
+
+  // frames before the start are skipped without being sampled. a nonzero
+  // start_ms wins over first_frame, which is then set to the frame it
+  // resolved to.
+  size_t first_frame;
+  size_t start_ms;
+
+  // file keeping keyframes between runs (see seekcache.h), so reaching a
+  // start decodes at most SEEK_KEYFRAME_INTERVAL - 1 frames once a run
+  // has passed it. NULL = none: keyframes before a start are only kept
+  // for later loads of the same gif in this process.
+  const char *seek_cache;
+
+  // frames over the power budget are scaled down as they are sampled
+  struct power_opts power;
+
+  // resample to this frame rate after extraction (see resample.h), 0 =
+  // the gif's own timing. done by anim_load(), not extract_gif_frames().
+  unsigned fps;
+
+  // keep frames compressed (see framestore.h), also done by anim_load()
+  int compress;
+
+  // wire format the frames are sampled into
+  enum pixel_format format;
+};
+
+// how many threads sample decoded frames, 0 (default) = one per CPU, 1 =
+// sample inline between decodes
+void extract_set_threads(int threads);
+
+// low-memory mode keeps no full-size image per frame: the decoder
+// composites only the pixels the LEDs sample, into one reused buffer.
+// decoding then needs about width * height bytes however large the gif.
+void extract_set_low_memory(int on);
+
+// whether a gif of gif_width x gif_height can be sampled onto a grid of
+// width x height LEDs. if not, why (len bytes) says so.
+int extract_fits(int gif_width, int gif_height, int width, int height,
+                 char *why, size_t len);
+
+// memory extract_gif_frames() and anim_load() would need for a gif,
+// without decoding it. compression is not accounted for.
+struct extract_estimate {
+  size_t frames; // what the loaded frames keep
+  size_t peak;   // frames plus decoder, index and sampling buffers
+};
+
+void extract_estimate(int gif_width, int gif_height, size_t frame_count,
+                      size_t duration_ms, const struct extract_opts *opts,
+                      struct extract_estimate *est);
+
+// samples every frame from the start onto the LED grid, in wire order
 size_t extract_gif_frames(const char *fname, uint8_t ***frames,
-                          size_t **delays_in_ms, float br);
+                          size_t **delays_in_ms, struct extract_opts *opts);
+
+// the same, encoding frames into fs (see framestore.h) as they are
+// sampled, so only the few still being sampled are ever held raw
+size_t extract_gif_packed(const char *fname, struct frame_store *fs,
+                          size_t **delays_in_ms, struct extract_opts *opts);
+
+// the frame playing ms into the animation (wrapping past its end)
+size_t frame_at_ms(const size_t *delays_in_ms, size_t frame_count,
+                   size_t ms);
 
 void free_frames_and_delays(uint8_t **frames, size_t *delays,
                             size_t frame_count);
@@ -0,0 +1,25 @@
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <stdint.h>
+
+// LED wiring of a panel. a layout spec is a comma separated list of:
+//
+//   serpentine (or zigzag)  every other line runs backwards
+//   columns                 lines run top to bottom instead of left to right
+//   rotate=90|180|270       panel is mounted rotated clockwise
+//   flip=h|v                panel is mirrored
+//   tiles=<cols>x<rows>     panel is a grid of equal tiles wired one after
+//                           another, left to right, top to bottom; the
+//                           options above apply inside each tile
+//   map=<file>              arbitrary wiring: whitespace separated grid
+//                           indices (y * width + x), one per LED in wire order
+//
+// an empty or NULL spec is plain row-major wiring.
+
+// compiles spec for a width x height grid into a table of width * height
+// entries: entry i is the row-major grid index shown by the i-th LED on
+// the wire. returns NULL (and prints why) on a bad spec.
+uint32_t *layout_compile(const char *spec, int width, int height);
+
+#endif // LAYOUT_H
@@ -0,0 +1,52 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ddp.h"
+
+// an output destination for DDP packets. sinks are shared: opening the
+// same spec twice returns the same sink with an extra reference.
+//
+// spec forms:
+//   "-"               stdout (default)
+//   "udp:<host>:<port>" connected UDP socket
+//   anything else     file or fifo path
+struct sink {
+  char *spec;
+  int fd;
+  uint16_t id; // names the sink in show files
+  uint8_t seq; // last DDP sequence number sent, 1-15
+  int refs;
+  struct sink *next;
+};
+
+struct show_writer;
+
+struct sink *sink_open(const char *spec);
+
+void sink_close(struct sink *s);
+
+// copies every packet sent from now on, to any sink, into a show file.
+// open sinks, and sinks opened later, are declared in it. NULL stops
+// recording.
+void sink_record(struct show_writer *w);
+
+// sends one complete, already serialized packet. returns 0 or -1.
+int sink_write(struct sink *s, const uint8_t *packet, size_t len);
+
+// sends one frame as one or more DDP packets. data longer than
+// DDP_MAX_DATA is fragmented by offset starting at header->offset; the
+// PUSH flag is only set on the last fragment and only when push is set.
+// every packet gets the sink's next sequence number, so receivers can
+// spot loss and reordering.
+// returns 0 on success, -1 on write error.
+int sink_send_frame(struct sink *s, const struct ddp_header *header,
+                    const uint8_t *data, size_t len, int push);
+
+// sends a header-only packet with PUSH set, so a receiver displays data
+// it was sent earlier without the PUSH flag. returns 0 or -1.
+int sink_send_push(struct sink *s, const struct ddp_header *header);
+
+#endif // OUTPUT_H
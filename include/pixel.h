@@ -0,0 +1,62 @@
+#ifndef PIXEL_H
+#define PIXEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// what one LED looks like on the wire. frames are stored in this format
+// from sampling on, so sending never converts anything.
+enum pixel_format {
+  PIXEL_RGB8,  // the default
+  PIXEL_RGBW8, // the part r, g and b have in common moves to white
+  PIXEL_RGB16, // big-endian 16 bit channels, gamma from 16 bit tables
+};
+
+// bytes per LED
+size_t pixel_size(enum pixel_format f);
+
+// channels per LED
+size_t pixel_channels(enum pixel_format f);
+
+// bytes per channel
+static inline size_t pixel_depth(enum pixel_format f) {
+  return f == PIXEL_RGB16 ? 2 : 1;
+}
+
+// the DDP data type byte
+uint8_t pixel_ddp_type(enum pixel_format f);
+
+// "rgb", "rgbw" or "rgb16". returns 0, or -1 for an unknown name
+int pixel_format_parse(const char *name, enum pixel_format *f);
+
+const char *pixel_format_name(enum pixel_format f);
+
+// interleaves n LEDs of planar post-gamma channels into RGBW, taking
+// min(r, g, b) out of each and sending it on the white channel
+void pixel_pack_rgbw(const uint8_t *r, const uint8_t *g, const uint8_t *b,
+                     size_t n, uint8_t *out);
+
+// looks n LEDs of planar raw channels up in per-channel 16 bit tables and
+// writes them big-endian
+void pixel_pack_rgb16(const uint8_t *r, const uint8_t *g, const uint8_t *b,
+                      const uint16_t lut[3][256], size_t n, uint8_t *out);
+
+// temporal dithering of RGB16 frames down to RGB8, one phase per packet.
+// a channel is its 8 bit part, plus one while its fraction is above the
+// phase's threshold; thresholds step through DITHER_PHASES levels in
+// bit-reversed order, so over a cycle the output averages to the 16 bit
+// value, to within 1/16 of a level, with its on-frames spread out rather
+// than bunched. each LED starts at a different point of the cycle, so the
+// panel doesn't pulse as a whole.
+#define DITHER_PHASES 8
+
+// the thresholds of every phase for led_count LEDs, DITHER_PHASES rows of
+// led_count * 3 bytes
+void pixel_dither_thresholds(size_t led_count, uint8_t *thr);
+
+// dithers n big-endian 16 bit channels into n bytes against one row of
+// thresholds
+void pixel_dither(const uint8_t *in, const uint8_t *thr, size_t n,
+                  uint8_t *out);
+
+#endif // PIXEL_H
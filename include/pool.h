@@ -0,0 +1,20 @@
+#ifndef POOL_H
+#define POOL_H
+
+// a fixed set of worker threads running queued jobs
+struct pool;
+
+typedef void (*pool_fn)(void *arg);
+
+// online CPUs, at least 1
+int pool_default_threads(void);
+
+struct pool *pool_create(int threads);
+
+// queues fn(arg) for the next free worker. returns 0 or -1.
+int pool_submit(struct pool *p, pool_fn fn, void *arg);
+
+// waits for queued jobs, then joins the workers
+void pool_destroy(struct pool *p);
+
+#endif // POOL_H
@@ -0,0 +1,49 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pixel.h"
+
+// current draw of post-gamma LED data. gamma-corrected values are PWM
+// duty, so a channel's current is linear in its value. a white channel
+// is one more die, so it counts like any other.
+struct power_opts {
+  uint32_t budget_ma;  // 0 = no limit
+  uint32_t channel_ma; // one channel at full duty
+  uint32_t idle_ma;    // each LED, even when dark
+};
+
+// sum of every byte in data
+uint64_t power_channel_sum(const uint8_t *data, size_t len);
+
+// sum of every big-endian 16 bit value in data
+uint64_t power_channel_sum16(const uint8_t *data, size_t len);
+
+// sum of each channel of a frame in format f, into
+// sums[0..pixel_channels(f))
+void power_channel_sums(const uint8_t *data, size_t len, enum pixel_format f,
+                        uint64_t sums[4]);
+
+// the largest channel sum of led_count LEDs in format f that stays within
+// the budget, or UINT64_MAX without one
+uint64_t power_budget_sum(size_t led_count, enum pixel_format f,
+                          const struct power_opts *p);
+
+// estimated draw of a frame of led_count LEDs in format f, in mA
+uint32_t power_estimate_ma(const uint8_t *data, size_t len, size_t led_count,
+                           enum pixel_format f, const struct power_opts *p);
+
+// scales a frame down, if needed, so its estimated draw fits the budget.
+// returns 1 if the frame was scaled.
+int power_limit(uint8_t *data, size_t len, size_t led_count,
+                enum pixel_format f, const struct power_opts *p);
+
+// power_limit() for a frame whose channel sum is already known, or known
+// not to exceed sum: the frame is scaled as if it were that much
+int power_limit_sum(uint8_t *data, size_t len, size_t led_count,
+                    enum pixel_format f, uint64_t sum,
+                    const struct power_opts *p);
+
+#endif // POWER_H
@@ -0,0 +1,15 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+#include <stdio.h>
+
+#include "gif.h"
+
+// prints a JSON report on a gif to fp: frame count, duration, canvas
+// size, the mix of interlaced, transparent and partial frames, and the
+// memory loading it with opts would take. only the block structure is
+// read, no image data is decoded. returns 0 if the gif can be played with
+// opts, -1 if not (the report says why).
+int probe_gif(const char *path, const struct extract_opts *opts, FILE *fp);
+
+#endif // PROBE_H
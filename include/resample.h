@@ -0,0 +1,41 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "framestore.h"
+#include "pixel.h"
+
+// an animation resampled to a fixed frame rate. frames may share buffers;
+// all of them point into store, which is the only allocation holding
+// pixels.
+struct resampled {
+  uint8_t **frames;
+  size_t *delays_in_ms;
+  size_t frame_count;
+  uint8_t *store;
+  size_t unique_count; // distinct frames in store
+};
+
+// resamples frames (shown for delays_in_ms each, looping) to fps. a frame
+// between two source frames is their linear crossfade, weighted by how
+// far into the first one it falls; the values are post-gamma, so this
+// blends in linear light. identical results are stored once. returns 0 or
+// -1; the source frames are left alone.
+int resample_frames(uint8_t *const *frames, const size_t *delays_in_ms,
+                    size_t frame_count, size_t frame_size,
+                    enum pixel_format format, unsigned fps,
+                    struct resampled *out);
+
+// the same from one compressed store into another (out, which this
+// starts). source frames are decoded as the blends reach them and every
+// blend is encoded as it is made, so neither side is ever held raw.
+// *out_delays is allocated for out's frames. returns 0 or -1.
+int resample_packed(const struct frame_store *src, const size_t *delays_in_ms,
+                    enum pixel_format format, unsigned fps,
+                    struct frame_store *out, size_t **out_delays);
+
+void resampled_free(struct resampled *r);
+
+#endif // RESAMPLE_H
@@ -0,0 +1,46 @@
+#ifndef SEEKCACHE_H
+#define SEEKCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// keyframes of one gif. a keyframe is the canvas a frame is drawn onto,
+// as gd_Index holds them; with one stored near a start point, seeking
+// decodes from there instead of from frame 0. keyframes are stored as
+// decoding passes them.
+//
+// a cache opened on a path is kept between runs for --resume: a header
+// identifying the gif and the canvas, then one record per keyframe, its
+// frame number and the canvas.
+struct seek_cache;
+
+// opens path for gif, or starts it over if it was written for another
+// version of the file or a different canvas (size, or the sampled points
+// of a sparse one, see points_hash). NULL on error.
+struct seek_cache *seek_cache_open(const char *path, const char *gif,
+                                   size_t canvas_size, uint64_t points_hash,
+                                   size_t frame_count, size_t interval);
+
+// keyframes for a single run, shared by every load of the same gif onto
+// the same canvas in this process: held in memory, or with on_disk in an
+// unlinked temporary file. the cache stays open until the process exits
+// and seek_cache_close() leaves it alone. NULL on error.
+struct seek_cache *seek_cache_shared(const char *gif, size_t canvas_size,
+                                     uint64_t points_hash, size_t frame_count,
+                                     size_t interval, int on_disk);
+
+// the stored keyframe nearest before or at frame n, in a new buffer of
+// canvas_size bytes, and its frame number in *frame. NULL if there is
+// none.
+uint8_t *seek_cache_find(struct seek_cache *c, size_t n, size_t *frame);
+
+// stores the canvas frame k is drawn onto, if k is on the keyframe
+// interval and not stored yet. a failed write disables the cache.
+void seek_cache_put(struct seek_cache *c, size_t k, const uint8_t *canvas);
+
+void seek_cache_close(struct seek_cache *c);
+
+// FNV-1a over a sparse canvas' points, 0 for none
+uint64_t seek_cache_points_hash(const size_t *points, size_t n);
+
+#endif // SEEKCACHE_H
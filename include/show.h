@@ -0,0 +1,57 @@
+#ifndef SHOW_H
+#define SHOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// show files: every DDP packet ddpctl emitted, with its send time, so a
+// show can be replayed later without decoding or color work.
+//
+// layout (host byte order, every record 8 byte aligned, so a mapped file
+// can be walked in place):
+//
+//   struct show_header
+//   struct show_record, payload, padding to 8 bytes
+//   ...
+//
+// a SHOW_SINK record names an output (payload is its spec) before its
+// first packet; SHOW_PACKET payloads are complete DDP packets; a final
+// SHOW_END record marks the length of the show.
+#define SHOW_MAGIC "DDPSHOW1"
+
+struct show_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+
+enum { SHOW_PACKET = 0, SHOW_SINK = 1, SHOW_END = 2 };
+
+struct show_record {
+  uint64_t t_ns; // since the start of the recording
+  uint32_t len;  // payload bytes, without padding
+  uint16_t sink; // output the packet went to
+  uint8_t type;
+  uint8_t reserved;
+};
+
+struct show_writer;
+
+struct show_writer *show_open(const char *path);
+
+void show_declare_sink(struct show_writer *w, uint16_t sink,
+                       const char *spec);
+
+// appends one packet made of the given pieces
+void show_write_packet(struct show_writer *w, uint16_t sink,
+                       const struct iovec *iov, int iovcnt);
+
+// writes the end marker and closes. returns 0 or -1 on write error.
+int show_close(struct show_writer *w);
+
+// plays a show at its recorded timing. output, if set, replaces every
+// recorded output. returns 0 or -1.
+int show_replay(const char *path, const char *output, int loop_count);
+
+#endif // SHOW_H
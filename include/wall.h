@@ -0,0 +1,37 @@
+#ifndef WALL_H
+#define WALL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// a large LED wall split across several controllers. the animation is
+// sampled once at the full wall resolution and every controller gets the
+// rectangle of LEDs it drives.
+struct wall_region {
+  char *output;    // sink spec of the controller
+  int x, y, w, h;  // rectangle on the wall, in LEDs
+  uint32_t offset; // DDP byte offset on the controller
+  char *layout;    // wiring of the controller's LEDs, NULL = row-major
+};
+
+struct wall {
+  int width; // whole wall, in LEDs
+  int height;
+  struct wall_region *regions;
+  size_t count;
+};
+
+// parses a layout file:
+//
+//   wall <width> <height>
+//   controller <output> <x> <y> <w> <h> [offset] [layout]
+//   ...
+//
+// layout is a wiring spec (see layout.h) over the controller's own
+// rectangle. blank lines and lines starting with '#' are ignored.
+// returns NULL and prints the offending line on error.
+struct wall *wall_load(const char *path);
+
+void wall_free(struct wall *w);
+
+#endif // WALL_H
@@ -118,6 +118,239 @@ ok:
     return gif;
 }
 
+/* Buffered reads for gd_scan(), which otherwise spends its time in one
+ * syscall per sub-block. Skips past the buffer become one lseek(). */
+typedef struct Reader {
+    int fd;
+    size_t pos, len;
+    int eof;
+    uint8_t buf[0x4000];
+} Reader;
+
+static int
+reader_byte(Reader *r)
+{
+    ssize_t n;
+
+    if (r->pos == r->len) {
+        n = read(r->fd, r->buf, sizeof(r->buf));
+        if (n <= 0) {
+            r->eof = 1;
+            return -1;
+        }
+        r->pos = 0;
+        r->len = (size_t) n;
+    }
+    return r->buf[r->pos++];
+}
+
+/* File offset of the next byte reader_byte() returns. */
+static off_t
+reader_tell(Reader *r)
+{
+    return lseek(r->fd, 0, SEEK_CUR) - (off_t) (r->len - r->pos);
+}
+
+static uint16_t
+reader_num(Reader *r)
+{
+    int lo = reader_byte(r);
+    int hi = reader_byte(r);
+
+    return (uint16_t) ((lo & 0xFF) + ((hi & 0xFF) << 8));
+}
+
+static void
+reader_skip(Reader *r, size_t n)
+{
+    size_t left = r->len - r->pos;
+
+    if (n <= left) {
+        r->pos += n;
+        return;
+    }
+    lseek(r->fd, n - left, SEEK_CUR);
+    r->pos = r->len = 0;
+}
+
+/* Skip sub-blocks up to their terminator. Return the bytes skipped. */
+static size_t
+reader_skip_sub_blocks(Reader *r)
+{
+    size_t total = 0;
+    int size;
+
+    while ((size = reader_byte(r)) > 0) {
+        reader_skip(r, size);
+        total += size;
+    }
+    return total;
+}
+
+/* What scan_frame() found of one frame, besides its GCE. */
+typedef struct ScanFrame {
+    off_t start;        /* first block of the frame (extension or image) */
+    uint16_t fx, fy, fw, fh;
+    uint8_t fdsz;
+    size_t lzw_bytes;   /* sub-block headers not counted */
+} ScanFrame;
+
+/* Read the next frame's blocks the way gd_get_frame() would, but skip
+ * image data instead of decompressing it. Extensions before the image
+ * descriptor belong to the frame: a GCE updates `gce`, which persists
+ * across frames as in the decoder, and a NETSCAPE block `loop_count`.
+ * Return 1 with `f` filled, 0 at the trailer, or -1 with `*error` set. */
+static int
+scan_frame(Reader *r, uint16_t width, uint16_t height, gd_GCE *gce,
+           uint16_t *loop_count, ScanFrame *f, const char **error)
+{
+    uint8_t rdit, app_id[8];
+    int i, sep, label;
+
+    f->start = reader_tell(r);
+    for (;;) {
+        sep = reader_byte(r);
+        if (sep == ',')
+            break;
+        if (sep == ';')
+            return 0;
+        if (sep != '!') {
+            *error = sep == -1 ? "truncated" : "bad block";
+            return -1;
+        }
+        label = reader_byte(r);
+        if (label == 0xF9) {
+            /* The same fields read_graphic_control_ext() reads. */
+            reader_skip(r, 1);
+            rdit = (uint8_t) reader_byte(r);
+            gce->disposal = (rdit >> 2) & 3;
+            gce->input = rdit & 2;
+            gce->transparency = rdit & 1;
+            gce->delay = reader_num(r);
+            gce->tindex = (uint8_t) reader_byte(r);
+            reader_skip(r, 1);
+        } else if (label == 0xFF) {
+            /* Block size (0x0B), identifier, authentication code. */
+            reader_skip(r, 1);
+            for (i = 0; i < 8; i++)
+                app_id[i] = (uint8_t) reader_byte(r);
+            reader_skip(r, 3);
+            if (!memcmp(app_id, "NETSCAPE", 8)) {
+                /* Sub-block size (0x03), constant byte (0x01), the
+                 * count and the terminator, as the decoder reads it. */
+                reader_skip(r, 2);
+                *loop_count = reader_num(r);
+                reader_skip(r, 1);
+            } else {
+                reader_skip_sub_blocks(r);
+            }
+        } else if (label == 0x01) {
+            /* Plain text: the 13 byte header block, then text. */
+            reader_skip(r, 13);
+            reader_skip_sub_blocks(r);
+        } else {
+            reader_skip_sub_blocks(r);
+        }
+        if (r->eof) {
+            *error = "truncated";
+            return -1;
+        }
+    }
+    f->fx = reader_num(r);
+    f->fy = reader_num(r);
+    f->fw = reader_num(r);
+    f->fh = reader_num(r);
+    f->fdsz = (uint8_t) reader_byte(r);
+    if (f->fx >= width || f->fy >= height) {
+        *error = "frame outside the canvas";
+        return -1;
+    }
+    if (f->fdsz & 0x80)
+        reader_skip(r, 3 * (1 << ((f->fdsz & 0x07) + 1)));
+    /* LZW minimum code size, then the data itself. */
+    reader_skip(r, 1);
+    f->lzw_bytes = reader_skip_sub_blocks(r);
+    if (r->eof) {
+        *error = "truncated";
+        return -1;
+    }
+    return 1;
+}
+
+/* Walk the block structure of `fname` with scan_frame(). Return 0 if the
+ * whole file is playable, -1 with `scan->error` set otherwise; what was
+ * counted up to the problem stays in `scan`. */
+int
+gd_scan(const char *fname, gd_Scan *scan)
+{
+    Reader *r;
+    struct stat st;
+    ScanFrame f;
+    gd_GCE gce;
+    uint8_t sigver[6];
+    uint8_t fdsz;
+    int i;
+
+    memset(scan, 0, sizeof(*scan));
+    r = calloc(1, sizeof(*r));
+    if (!r) {
+        scan->error = "out of memory";
+        return -1;
+    }
+    r->fd = open(fname, O_RDONLY);
+    if (r->fd == -1) {
+        free(r);
+        scan->error = "cannot open file";
+        return -1;
+    }
+#ifdef _WIN32
+    setmode(r->fd, O_BINARY);
+#endif
+    if (fstat(r->fd, &st) == 0)
+        scan->file_size = st.st_size;
+    /* Header, as checked by gd_open_gif(). */
+    for (i = 0; i < 6; i++)
+        sigver[i] = (uint8_t) reader_byte(r);
+    if (memcmp(sigver, "GIF", 3) != 0) {
+        scan->error = "invalid signature";
+        goto done;
+    }
+    if (memcmp(&sigver[3], "89a", 3) != 0) {
+        scan->error = "invalid version";
+        goto done;
+    }
+    scan->width = reader_num(r);
+    scan->height = reader_num(r);
+    fdsz = (uint8_t) reader_byte(r);
+    if (!(fdsz & 0x80)) {
+        scan->error = "no global color table";
+        goto done;
+    }
+    /* Background index, aspect ratio and the GCT. */
+    reader_skip(r, 2 + 3 * (1 << ((fdsz & 0x07) + 1)));
+    memset(&gce, 0, sizeof(gce));
+    while (scan_frame(r, scan->width, scan->height, &gce,
+                      &scan->loop_count, &f, &scan->error) == 1) {
+        scan->frames++;
+        scan->delay += gce.delay;
+        scan->zero_delay += gce.delay == 0;
+        scan->interlaced += (f.fdsz & 0x40) != 0;
+        scan->local_palette += (f.fdsz & 0x80) != 0;
+        scan->transparent += gce.transparency;
+        scan->restore_previous += gce.disposal == 3;
+        scan->lzw_bytes += f.lzw_bytes;
+        scan->partial += f.fx > 0 || f.fy > 0 ||
+                         MIN(f.fw, scan->width - f.fx) < scan->width ||
+                         MIN(f.fh, scan->height - f.fy) < scan->height;
+    }
+    if (!scan->error && scan->frames == 0)
+        scan->error = "no frames";
+done:
+    close(r->fd);
+    free(r);
+    return scan->error ? -1 : 0;
+}
+
 static void
 discard_sub_blocks(gd_GIF *gif)
 {
@@ -441,11 +674,40 @@ read_image(gd_GIF *gif)
     return read_image_data(gif, interlace);
 }
 
+/* Bytes of canvas: the whole image, or only the sampled points. */
+static size_t
+canvas_size(gd_GIF *gif)
+{
+    if (gif->points)
+        return gif->npoints * 3;
+    return (size_t) gif->width * gif->height * 3;
+}
+
+static int
+in_frame_rect(gd_GIF *gif, size_t p)
+{
+    int x = p % gif->width, y = p / gif->width;
+    return x >= gif->fx && x < gif->fx + gif->fw &&
+           y >= gif->fy && y < gif->fy + gif->fh;
+}
+
 static void
 render_frame_rect(gd_GIF *gif, uint8_t *buffer)
 {
     int i, j, k;
+    size_t n;
     uint8_t index, *color;
+    if (gif->points) {
+        for (n = 0; n < gif->npoints; n++) {
+            if (!in_frame_rect(gif, gif->points[n]))
+                continue;
+            index = gif->frame[gif->points[n]];
+            color = &gif->palette->colors[index*3];
+            if (!gif->gce.transparency || index != gif->gce.tindex)
+                memcpy(&buffer[n*3], color, 3);
+        }
+        return;
+    }
     i = gif->fy * gif->width + gif->fx;
     for (j = 0; j < gif->fh; j++) {
         for (k = 0; k < gif->fw; k++) {
@@ -462,10 +724,17 @@ static void
 dispose(gd_GIF *gif)
 {
     int i, j, k;
+    size_t n;
     uint8_t *bgcolor;
     switch (gif->gce.disposal) {
     case 2: /* Restore to background color. */
         bgcolor = &gif->palette->colors[gif->bgindex*3];
+        if (gif->points) {
+            for (n = 0; n < gif->npoints; n++)
+                if (in_frame_rect(gif, gif->points[n]))
+                    memcpy(&gif->canvas[n*3], bgcolor, 3);
+            break;
+        }
         i = gif->fy * gif->width + gif->fx;
         for (j = 0; j < gif->fh; j++) {
             for (k = 0; k < gif->fw; k++)
@@ -505,10 +774,43 @@ gd_get_frame(gd_GIF *gif)
 void
 gd_render_frame(gd_GIF *gif, uint8_t *buffer)
 {
-    memcpy(buffer, gif->canvas, gif->width * gif->height * 3);
+    memcpy(buffer, gif->canvas, canvas_size(gif));
     render_frame_rect(gif, buffer);
 }
 
+/* Switch to sparse mode: from now on only the `n` listed pixels are
+ * composited, and gd_render_frame() writes `n` RGB triples. Frees the
+ * full RGB canvas, so large images decode in about width * height bytes.
+ * Call before reading any frame or building an index. Return 0 or -1. */
+int
+gd_set_points(gd_GIF *gif, const size_t *points, size_t n)
+{
+    size_t i, *copy;
+    uint8_t *canvas, *frame;
+
+    if (gif->points || n == 0)
+        return -1;
+    copy = malloc(n * sizeof(*copy));
+    canvas = malloc(n * 3);
+    if (!copy || !canvas) {
+        free(copy);
+        free(canvas);
+        return -1;
+    }
+    memcpy(copy, points, n * sizeof(*copy));
+    for (i = 0; i < n; i++)
+        memcpy(&canvas[i*3], &gif->canvas[points[i]*3], 3);
+    /* The full canvas shares the frame's allocation; keep only the
+     * frame part. */
+    frame = realloc(gif->frame, gif->width * gif->height);
+    if (frame)
+        gif->frame = frame;
+    gif->canvas = canvas;
+    gif->points = copy;
+    gif->npoints = n;
+    return 0;
+}
+
 int
 gd_is_bgcolor(gd_GIF *gif, uint8_t color[3])
 {
@@ -526,5 +828,129 @@ gd_close_gif(gd_GIF *gif)
 {
     close(gif->fd);
     free(gif->frame);    
+    if (gif->points) {
+        free(gif->canvas);
+        free(gif->points);
+    }
     free(gif);
 }
+
+/* Restore the decoder to the state right before frame `k` is read:
+ * canvas as snapshotted, file at the frame's first block, and the GCE
+ * that frame would inherit if it has none of its own. An empty frame
+ * rectangle turns the pending dispose() into a no-op. */
+static void
+restore_keyframe(gd_GIF *gif, const gd_Index *index, size_t k)
+{
+    memcpy(gif->canvas, index->keyframes[k / index->interval],
+           canvas_size(gif));
+    if (k > 0)
+        gif->gce = index->gces[k - 1];
+    else
+        memset(&gif->gce, 0, sizeof(gif->gce));
+    gif->fw = gif->fh = 0;
+    lseek(gif->fd, index->offsets[k], SEEK_SET);
+}
+
+/* Walk the frames of `gif` with scan_frame(), recording each frame's
+ * offset and GCE. Only frame 0's canvas is snapshotted, so call this
+ * before reading any frame. Frames up to the first structural problem
+ * are indexed. Leaves `gif` ready to read frame 0. Return NULL on error
+ * or if there are no frames. */
+gd_Index *
+gd_index_build(gd_GIF *gif, int interval)
+{
+    gd_Index *index;
+    Reader *r;
+    size_t cap, k;
+    size_t size = canvas_size(gif);
+    off_t *offsets;
+    gd_GCE gce, *gces;
+    ScanFrame f;
+    uint16_t loop_count;
+    const char *error;
+
+    if (interval < 1)
+        interval = 1;
+    index = calloc(1, sizeof(*index));
+    r = calloc(1, sizeof(*r));
+    if (!index || !r)
+        goto fail;
+    index->interval = interval;
+    r->fd = gif->fd;
+    lseek(gif->fd, gif->anim_start, SEEK_SET);
+    memset(&gce, 0, sizeof(gce));
+    cap = 0;
+    k = 0;
+    while (scan_frame(r, gif->width, gif->height, &gce, &loop_count, &f,
+                      &error) == 1) {
+        if (k == cap) {
+            cap = cap ? cap * 2 : 64;
+            offsets = realloc(index->offsets, cap * sizeof(*offsets));
+            if (offsets) index->offsets = offsets;
+            gces = realloc(index->gces, cap * sizeof(*gces));
+            if (gces) index->gces = gces;
+            if (!offsets || !gces)
+                goto fail;
+        }
+        index->offsets[k] = f.start;
+        index->gces[k] = gce;
+        k++;
+    }
+    if (k == 0)
+        goto fail;
+    index->count = k;
+    index->keyframes = calloc((k + interval - 1) / interval,
+                              sizeof(*index->keyframes));
+    if (!index->keyframes)
+        goto fail;
+    index->keyframes[0] = malloc(size);
+    if (!index->keyframes[0])
+        goto fail;
+    memcpy(index->keyframes[0], gif->canvas, size);
+    free(r);
+    restore_keyframe(gif, index, 0);
+    return index;
+fail:
+    free(r);
+    gd_index_free(index);
+    lseek(gif->fd, gif->anim_start, SEEK_SET);
+    return NULL;
+}
+
+/* Position `gif` so the next gd_get_frame() reads frame `n`, decoding
+ * forward from the nearest keyframe at or before it. Return 0 or -1. */
+int
+gd_index_seek(gd_GIF *gif, const gd_Index *index, size_t n)
+{
+    size_t k;
+
+    if (n >= index->count)
+        return -1;
+    k = n / index->interval;
+    while (!index->keyframes[k])
+        k--;
+    k *= index->interval;
+    restore_keyframe(gif, index, k);
+    for (; k < n; k++)
+        if (gd_get_frame(gif) != 1)
+            return -1;
+    return 0;
+}
+
+void
+gd_index_free(gd_Index *index)
+{
+    size_t i, nkeys;
+
+    if (!index) return;
+    if (index->keyframes) {
+        nkeys = (index->count + index->interval - 1) / index->interval;
+        for (i = 0; i < nkeys; i++)
+            free(index->keyframes[i]);
+    }
+    free(index->keyframes);
+    free(index->gces);
+    free(index->offsets);
+    free(index);
+}
@@ -1,6 +1,7 @@
 #ifndef GIFDEC_H
 #define GIFDEC_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -40,15 +41,58 @@ typedef struct gd_GIF {
     uint16_t fx, fy, fw, fh;
     uint8_t bgindex;
     uint8_t *canvas, *frame;
+    /* Sparse mode: the canvas only keeps the `npoints` pixels listed in
+     * `points` (offsets into the image), as RGB, in that order. */
+    size_t *points;
+    size_t npoints;
 } gd_GIF;
 
+/* Random access index: where every frame starts and which GCE it uses,
+ * plus room for a canvas snapshot every `interval` frames so seeking
+ * survives disposal modes. */
+typedef struct gd_Index {
+    size_t count;
+    off_t *offsets;     /* first block of each frame (extension or image) */
+    gd_GCE *gces;       /* GCE in effect for each frame */
+    int interval;
+    uint8_t **keyframes; /* canvas before frame k * interval, NULL where
+                          * none was taken. Frame 0's always is; callers
+                          * may add more (malloc'd, freed with the index). */
+} gd_Index;
+
+/* Structure of a file as gd_scan() found it, without decoding any image
+ * data. Frame counts are per kind, so each can be compared to `frames`. */
+typedef struct gd_Scan {
+    off_t file_size;
+    uint16_t width, height;
+    uint16_t loop_count;    /* NETSCAPE extension, 0 = forever */
+    size_t frames;
+    unsigned long delay;    /* sum of GCE delays, in 1/100 s */
+    size_t zero_delay;      /* frames with a delay of 0 */
+    size_t interlaced;
+    size_t transparent;     /* frames whose GCE has a transparent index */
+    size_t local_palette;   /* frames with their own color table */
+    size_t partial;         /* frames smaller than the canvas */
+    size_t restore_previous; /* frames disposed to the previous canvas */
+    size_t lzw_bytes;       /* compressed image data, sub-block headers
+                             * not counted */
+    const char *error;      /* NULL, or why gd_open_gif() would fail or
+                             * decoding would stop early */
+} gd_Scan;
+
 gd_GIF *gd_open_gif(const char *fname);
+int gd_scan(const char *fname, gd_Scan *scan);
 int gd_get_frame(gd_GIF *gif);
 void gd_render_frame(gd_GIF *gif, uint8_t *buffer);
+int gd_set_points(gd_GIF *gif, const size_t *points, size_t n);
 int gd_is_bgcolor(gd_GIF *gif, uint8_t color[3]);
 void gd_rewind(gd_GIF *gif);
 void gd_close_gif(gd_GIF *gif);
 
+gd_Index *gd_index_build(gd_GIF *gif, int interval);
+int gd_index_seek(gd_GIF *gif, const gd_Index *index, size_t n);
+void gd_index_free(gd_Index *index);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,266 @@
+#include "../include/anim.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "../include/clock.h"
+#include "../include/config.h"
+#include "../include/power.h"
+#include "../include/resample.h"
+
+// every live shared animation, looked up by file identity
+static struct anim *g_anims = NULL;
+
+// same sampling, treating a NULL map as row-major over the whole grid
+static int same_opts(const struct anim *a, const struct extract_opts *o) {
+  const struct extract_opts *p = &a->opts;
+
+  if (p->brightness != o->brightness || p->width != o->width ||
+      p->height != o->height || p->start_ms != o->start_ms ||
+      p->power.budget_ma != o->power.budget_ma ||
+      p->power.channel_ma != o->power.channel_ma ||
+      p->power.idle_ma != o->power.idle_ma || p->fps != o->fps ||
+      p->compress != o->compress || p->format != o->format ||
+      (o->start_ms == 0 && p->first_frame != o->first_frame))
+    return 0;
+
+  if (!a->map || !o->map)
+    return a->map == o->map;
+  return a->led_count == o->led_count &&
+         memcmp(a->map, o->map, o->led_count * sizeof(*o->map)) == 0;
+}
+
+// frees the frames, however they are stored, but not the delays
+static void free_pixels(struct anim *a) {
+  if (a->packed) {
+    frame_store_free(a->packed);
+    free(a->packed);
+  } else if (a->store) {
+    free(a->store);
+    free(a->frames);
+  } else if (a->frames) {
+    for (size_t i = 0; i < a->frame_count; i++)
+      free(a->frames[i]);
+    free(a->frames);
+  }
+  a->frames = NULL;
+  a->store = NULL;
+  a->packed = NULL;
+}
+
+// samples every frame into its own buffer, or resamples them into one
+// shared store
+static int load_frames(struct anim *a, const char *path) {
+  a->frame_count =
+      extract_gif_frames(path, &a->frames, &a->delays_in_ms, &a->opts);
+  if (a->frame_count == 0 || !a->frames || !a->delays_in_ms) {
+    fprintf(stderr, "failed to extract frames: %s\n", path);
+    return -1;
+  }
+
+  // blends are computed once here, so playback stays a pointer walk
+  if (a->opts.fps) {
+    struct resampled r;
+    if (resample_frames(a->frames, a->delays_in_ms, a->frame_count,
+                        a->frame_size, a->opts.format, a->opts.fps,
+                        &r) != 0) {
+      fprintf(stderr, "failed to resample %s to %u fps\n", path,
+              a->opts.fps);
+      free_frames_and_delays(a->frames, a->delays_in_ms, a->frame_count);
+      return -1;
+    }
+
+    free_frames_and_delays(a->frames, a->delays_in_ms, a->frame_count);
+    a->frames = r.frames;
+    a->delays_in_ms = r.delays_in_ms;
+    a->frame_count = r.frame_count;
+    a->store = r.store;
+  }
+
+  return 0;
+}
+
+// samples the frames straight into a compressed store, resampling them
+// store to store if asked to, so the frames are never all held raw
+static int load_packed(struct anim *a, const char *path) {
+  struct frame_store *fs = (struct frame_store *)malloc(sizeof(*fs));
+  if (!fs)
+    return -1;
+
+  a->frame_count = extract_gif_packed(path, fs, &a->delays_in_ms, &a->opts);
+  if (a->frame_count == 0) {
+    fprintf(stderr, "failed to extract frames: %s\n", path);
+    free(fs);
+    return -1;
+  }
+
+  if (a->opts.fps) {
+    struct frame_store *r = (struct frame_store *)malloc(sizeof(*r));
+    size_t *delays;
+    if (!r || resample_packed(fs, a->delays_in_ms, a->opts.format,
+                              a->opts.fps, r, &delays) != 0) {
+      fprintf(stderr, "failed to resample %s to %u fps\n", path,
+              a->opts.fps);
+      free(r);
+      frame_store_free(fs);
+      free(fs);
+      free(a->delays_in_ms);
+      return -1;
+    }
+
+    frame_store_free(fs);
+    free(fs);
+    free(a->delays_in_ms);
+    fs = r;
+    a->delays_in_ms = delays;
+    a->frame_count = r->frame_count;
+  }
+
+  a->packed = fs;
+  return 0;
+}
+
+struct anim *anim_load(const char *path, const struct extract_opts *opts) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    fprintf(stderr, "failed to stat %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  struct anim *a = (struct anim *)calloc(1, sizeof(*a));
+  if (!a)
+    return NULL;
+
+  a->opts = *opts;
+  a->led_count =
+      opts->map ? opts->led_count : (size_t)opts->width * opts->height;
+
+  if (opts->map) {
+    a->map = (uint32_t *)malloc(a->led_count * sizeof(*a->map));
+    if (!a->map) {
+      free(a);
+      return NULL;
+    }
+    memcpy(a->map, opts->map, a->led_count * sizeof(*a->map));
+  }
+  a->opts.map = a->map;
+
+  a->frame_size = a->led_count * pixel_size(opts->format);
+
+  int loaded = opts->compress ? load_packed(a, path) : load_frames(a, path);
+  if (loaded != 0) {
+    free(a->map);
+    free(a);
+    return NULL;
+  }
+
+  a->dev = st.st_dev;
+  a->ino = st.st_ino;
+  a->refs = 1;
+  return a;
+}
+
+struct anim *anim_acquire(const char *path, const struct extract_opts *opts) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    fprintf(stderr, "failed to stat %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  // keyed by device and inode so different spellings of one path match
+  for (struct anim *a = g_anims; a; a = a->next) {
+    if (a->dev == st.st_dev && a->ino == st.st_ino && same_opts(a, opts)) {
+      a->refs += 1;
+      return a;
+    }
+  }
+
+  struct anim *a = anim_load(path, opts);
+  if (!a)
+    return NULL;
+
+  a->next = g_anims;
+  g_anims = a;
+  return a;
+}
+
+void anim_release(struct anim *a) {
+  if (!a || --a->refs > 0)
+    return;
+
+  // a no-op for animations from anim_load, which are never listed
+  for (struct anim **p = &g_anims; *p; p = &(*p)->next) {
+    if (*p == a) {
+      *p = a->next;
+      break;
+    }
+  }
+
+  free_pixels(a);
+  free(a->channel_sums);
+  free(a->delays_in_ms);
+  free(a->map);
+  free(a);
+}
+
+int anim_sum_channels(struct anim *a) {
+  a->channel_sums =
+      (uint64_t(*)[4])malloc(a->frame_count * sizeof(*a->channel_sums));
+  if (!a->channel_sums)
+    return -1;
+
+  struct frame_cursor c = {0};
+  for (size_t i = 0; i < a->frame_count; i++) {
+    const uint8_t *frame = anim_frame(a, i, &c);
+    if (!frame) {
+      frame_cursor_free(&c);
+      free(a->channel_sums);
+      a->channel_sums = NULL;
+      return -1;
+    }
+    power_channel_sums(frame, a->frame_size, a->opts.format,
+                       a->channel_sums[i]);
+  }
+
+  frame_cursor_free(&c);
+  return 0;
+}
+
+const uint8_t *anim_frame(const struct anim *a, size_t i,
+                          struct frame_cursor *c) {
+  if (a->packed)
+    return frame_cursor_get(c, a->packed, i);
+  return a->frames[i];
+}
+
+void anim_report(FILE *fp) {
+  for (const struct anim *a = g_anims; a; a = a->next) {
+    size_t raw = a->frame_count * a->frame_size;
+    if (!a->packed) {
+      fprintf(fp, "anim: %zu frames, %.1f KiB\n", a->frame_count,
+              (double)raw / 1024.0);
+      continue;
+    }
+
+    // a few sequential passes, the way playback walks the frames
+    struct frame_cursor c = {0};
+    size_t passes = 8;
+    uint64_t t0 = mono_ns();
+    for (size_t p = 0; p < passes; p++)
+      for (size_t i = 0; i < a->frame_count; i++)
+        anim_frame(a, i, &c);
+    uint64_t ns = mono_ns() - t0;
+    frame_cursor_free(&c);
+
+    size_t packed = frame_store_bytes(a->packed);
+    fprintf(fp,
+            "anim: %zu frames, %.1f KiB compressed to %.1f KiB (%.1fx),"
+            " decode %.2f us/frame\n",
+            a->frame_count, (double)raw / 1024.0, (double)packed / 1024.0,
+            packed ? (double)raw / (double)packed : 0.0,
+            (double)ns / 1000.0 / (double)(passes * a->frame_count));
+  }
+}
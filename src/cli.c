@@ -5,17 +5,126 @@
 #include <stdlib.h>
 
 #include "../include/cli.h"
+#include "../include/clock.h"
+#include "../include/config.h"
+
+// long-only options
+enum {
+  OPT_START_FRAME = 0x100,
+  OPT_START_TIME,
+  OPT_RESUME,
+  OPT_RECORD,
+  OPT_REPLAY,
+  OPT_CHANNEL_MA,
+  OPT_BENCH,
+  OPT_LOW_MEM,
+  OPT_FPS,
+  OPT_COMPRESS,
+  OPT_START_AT,
+  OPT_SYNC_GROUP,
+  OPT_FORMAT,
+  OPT_PROBE,
+  OPT_DITHER,
+  OPT_DITHER_HZ,
+};
+
+static const struct option long_opts[] = {
+    {"start-frame", required_argument, NULL, OPT_START_FRAME},
+    {"start-time", required_argument, NULL, OPT_START_TIME},
+    {"resume", required_argument, NULL, OPT_RESUME},
+    {"record", required_argument, NULL, OPT_RECORD},
+    {"replay", required_argument, NULL, OPT_REPLAY},
+    {"channel-ma", required_argument, NULL, OPT_CHANNEL_MA},
+    {"bench", no_argument, NULL, OPT_BENCH},
+    {"low-mem", no_argument, NULL, OPT_LOW_MEM},
+    {"fps", required_argument, NULL, OPT_FPS},
+    {"compress", no_argument, NULL, OPT_COMPRESS},
+    {"start-at", required_argument, NULL, OPT_START_AT},
+    {"sync-group", no_argument, NULL, OPT_SYNC_GROUP},
+    {"format", required_argument, NULL, OPT_FORMAT},
+    {"probe", no_argument, NULL, OPT_PROBE},
+    {"dither", no_argument, NULL, OPT_DITHER},
+    {"dither-hz", required_argument, NULL, OPT_DITHER_HZ},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0},
+};
+
+// parses a non-negative integer option or exits
+static size_t parse_count(const char *arg, const char *what) {
+  char *end;
+  errno = 0;
+  unsigned long long v = strtoull(arg, &end, 10);
+
+  if (errno || end == arg || *end != '\0' || arg[0] == '-') {
+    fprintf(stderr, "invalid %s: %s\n", what, arg);
+    exit(1);
+  }
+
+  return (size_t)v;
+}
+
+// parses "<seconds>[.<fraction>]" since the unix epoch into ns, or exits.
+// done by hand: a double can't hold today's time to the nanosecond.
+static int64_t parse_epoch(const char *arg) {
+  char *end;
+  errno = 0;
+  unsigned long long sec = strtoull(arg, &end, 10);
+
+  int64_t ns = 0;
+  if (!errno && end != arg && *end == '.') {
+    int64_t scale = (int64_t)NS_PER_SEC;
+    for (end++; *end >= '0' && *end <= '9'; end++) {
+      scale /= 10;
+      ns += (*end - '0') * scale;
+    }
+  }
+
+  if (errno || end == arg || *end != '\0' || arg[0] == '-' ||
+      sec > (unsigned long long)(INT64_MAX / (int64_t)NS_PER_SEC) - 1) {
+    fprintf(stderr, "invalid start time: %s (seconds since 1970)\n", arg);
+    exit(1);
+  }
+
+  return (int64_t)sec * (int64_t)NS_PER_SEC + ns;
+}
 
 void parse_cli(int argc, char **argv, Config *cfg) {
   int opt;
+  int not_replay = 0; // options --replay has no use for, see below
+  int dither_hz = 0;  // --dither-hz, applied once --dither is known
+
+  while ((opt = getopt_long(argc, argv, "f:b:l:o:m:w:L:d:P:j:h", long_opts,
+                            NULL)) != -1) {
+    // counted as given, not by value: -b 0.5 or -j 0 equal the defaults
+    if (opt != 'o' && opt != 'l' && opt != OPT_REPLAY)
+      not_replay++;
 
-  while ((opt = getopt(argc, argv, "f:b:l:h")) != -1) {
     switch (opt) {
 
     case 'f':
       cfg->filename = optarg;
       break;
 
+    case 'o':
+      cfg->output = optarg;
+      break;
+
+    case 'm':
+      cfg->manifest = optarg;
+      break;
+
+    case 'w':
+      cfg->layout = optarg;
+      break;
+
+    case 'L':
+      cfg->wiring = optarg;
+      break;
+
+    case 'd':
+      cfg->socket = optarg;
+      break;
+
     case 'b': {
       char *end;
       errno = 0;
@@ -54,19 +163,247 @@ void parse_cli(int argc, char **argv, Config *cfg) {
       break;
     }
 
+    case OPT_START_FRAME:
+      cfg->start_frame = parse_count(optarg, "start frame");
+      break;
+
+    case OPT_START_TIME:
+      cfg->start_ms = parse_count(optarg, "start time");
+      break;
+
+    case OPT_RESUME:
+      cfg->resume = optarg;
+      break;
+
+    case 'P': {
+      size_t ma = parse_count(optarg, "power budget");
+      if (ma > UINT32_MAX) {
+        fprintf(stderr, "power budget out of range\n");
+        exit(1);
+      }
+      cfg->power_budget_ma = (uint32_t)ma;
+      break;
+    }
+
+    case OPT_CHANNEL_MA: {
+      size_t ma = parse_count(optarg, "channel current");
+      if (ma == 0) {
+        fprintf(stderr, "channel current must be > 0\n");
+        exit(1);
+      }
+      if (ma > UINT32_MAX) {
+        fprintf(stderr, "channel current out of range\n");
+        exit(1);
+      }
+      cfg->channel_ma = (uint32_t)ma;
+      break;
+    }
+
+    case 'j': {
+      size_t n = parse_count(optarg, "thread count");
+      if (n > 1024) {
+        fprintf(stderr, "thread count out of range\n");
+        exit(1);
+      }
+      cfg->threads = (int)n;
+      break;
+    }
+
+    case OPT_BENCH:
+      cfg->bench = 1;
+      break;
+
+    case OPT_LOW_MEM:
+      cfg->low_memory = 1;
+      break;
+
+    case OPT_COMPRESS:
+      cfg->compress = 1;
+      break;
+
+    case OPT_FPS: {
+      size_t fps = parse_count(optarg, "frame rate");
+      if (fps == 0 || fps > 1000) {
+        fprintf(stderr, "frame rate out of range: %s (1-1000)\n", optarg);
+        exit(1);
+      }
+      cfg->fps = (unsigned)fps;
+      break;
+    }
+
+    case OPT_START_AT:
+      cfg->start_at_ns = parse_epoch(optarg);
+      cfg->start_at = 1;
+      break;
+
+    case OPT_SYNC_GROUP:
+      cfg->sync_group = 1;
+      break;
+
+    case OPT_FORMAT:
+      if (pixel_format_parse(optarg, &cfg->format) != 0) {
+        fprintf(stderr, "invalid pixel format: %s (rgb, rgbw, rgb16)\n",
+                optarg);
+        exit(1);
+      }
+      break;
+
+    case OPT_PROBE:
+      cfg->probe = 1;
+      break;
+
+    case OPT_DITHER:
+      cfg->dither = DITHER_DEFAULT_HZ;
+      break;
+
+    case OPT_DITHER_HZ: {
+      size_t hz = parse_count(optarg, "dither rate");
+      if (hz == 0 || hz > 1000) {
+        fprintf(stderr, "dither rate out of range: %s (1-1000)\n", optarg);
+        exit(1);
+      }
+      dither_hz = (int)hz;
+      break;
+    }
+
+    case OPT_RECORD:
+      cfg->record = optarg;
+      break;
+
+    case OPT_REPLAY:
+      cfg->replay = optarg;
+      break;
+
     case 'h':
     default:
       fprintf(stderr,
-              "usage: %s -f <gif> [-b <0-1>] [-l <loops>]\n"
-              "  -f <gif>    GIF filename (required)\n"
+              "usage: %s -f <gif> [-o <output>] [-L <wiring>] [-b <0-1>]"
+              " [-l <loops>]\n"
+              "       %s -f <gif> -w <layout> [-b <0-1>] [-l <loops>]\n"
+              "       %s -m <manifest> [-b <0-1>] [-l <loops>]\n"
+              "       %s -d <socket> [-o <output>] [-L <wiring>] [-b <0-1>]\n"
+              "       %s --replay <show> [-o <output>] [-l <loops>]\n"
+              "  -f <gif>    GIF filename (required unless -m)\n"
+              "  -o <out>    output: - (stdout, default), udp:<host>:<port>"
+              " or a file\n"
+              "  -m <file>   multi-stream manifest, one"
+              " \"<gif> [output] [offset] [wiring]\" per line\n"
+              "  -w <file>   wall layout: fan -f out to several controllers\n"
+              "  -L <spec>   LED wiring, e.g. serpentine,rotate=90,"
+              "tiles=2x2 or map=<file>\n"
+              "  -d <path>   daemon mode, controlled over a unix socket\n"
               "  -b <0-1>    brightness (default 0.5)\n"
-              "  -l <n>      loop count (-1 = infinite, default)\n",
-              argv[0]);
+              "  -l <n>      loop count (-1 = infinite, default)\n"
+              "  -P <mA>     power budget: scale frames that would draw"
+              " more\n"
+              "  --channel-ma <mA>  draw of one channel at full, for -P"
+              " (default %d)\n"
+              "  -j <n>      threads sampling decoded frames (default: one"
+              " per CPU)\n"
+              "  --bench     load the animations, print timings and exit\n"
+              "  --probe     print -f's frames, size and memory needs as"
+              " JSON, without\n"
+              "              decoding it, and exit\n"
+              "  --low-mem   decode only the pixels the LEDs sample, for"
+              " huge gifs\n"
+              "  --fps <n>   play at a fixed frame rate, crossfading"
+              " between gif frames\n"
+              "  --compress  keep frames run-length/delta compressed in"
+              " memory\n"
+              "  --format <f>  rgb (default), rgbw (white extracted) or"
+              " rgb16\n"
+              "  --dither    keep 16 bit precision and dither rgb output"
+              " over time\n"
+              "  --dither-hz <n>  resend rate of --dither's phases"
+              " (default %d),\n"
+              "                   needs --dither\n"
+              "  --start-frame <n>  start playing at frame n\n"
+              "  --start-time <ms>  start playing ms into the animation\n"
+              "  --start-at <sec>   play on a timeline starting at this"
+              " unix time, so\n"
+              "                     instances sharing it stay in phase\n"
+              "  --sync-group       phase-lock to the wall clock; loops"
+              " count from joining\n"
+              "  --resume <file>    start where the last run stopped and"
+              " save the position on exit\n"
+              "  --record <file>    also write every sent packet to a show"
+              " file\n"
+              "  --replay <file>    send a recorded show again, to -o or"
+              " its recorded outputs\n",
+              argv[0], argv[0], argv[0], argv[0], argv[0], LED_CHANNEL_MA,
+              DITHER_DEFAULT_HZ);
       exit(0);
     }
   }
 
-  if (!cfg->filename) {
+  // a rate alone doesn't turn dithering on
+  if (dither_hz && !cfg->dither) {
+    fprintf(stderr, "--dither-hz needs --dither\n");
+    exit(1);
+  }
+  if (dither_hz)
+    cfg->dither = dither_hz;
+
+  // a show holds the packets as sent, so nothing that shapes them applies
+  if (cfg->replay) {
+    if (not_replay) {
+      fprintf(stderr, "--replay only takes -o and -l\n");
+      exit(1);
+    }
+    return;
+  }
+
+  if (cfg->filename && cfg->manifest) {
+    fprintf(stderr, "-f and -m are mutually exclusive\n");
+    exit(1);
+  }
+
+  if (cfg->layout && !cfg->filename) {
+    fprintf(stderr, "-w needs a GIF (-f)\n");
+    exit(1);
+  }
+
+  // a wall's controllers and a manifest's lines carry their own wiring
+  if (cfg->wiring && (cfg->layout || cfg->manifest)) {
+    fprintf(stderr, "-L only applies to a single -f panel, not -w/-m\n");
+    exit(1);
+  }
+
+  if ((cfg->start_frame || cfg->start_ms || cfg->resume) && !cfg->filename) {
+    fprintf(stderr, "--start-frame/--start-time/--resume need -f\n");
+    exit(1);
+  }
+
+  if ((cfg->start_at || cfg->sync_group) &&
+      (cfg->start_frame || cfg->start_ms || cfg->resume)) {
+    fprintf(stderr, "--start-at/--sync-group pick the start frame"
+                    " themselves\n");
+    exit(1);
+  }
+
+  // frames are held and resent with the next phase, so dithering never
+  // needs --fps; frames only crossfade if it is given
+  if (cfg->dither && cfg->format != PIXEL_RGB8) {
+    fprintf(stderr, "--dither sends rgb, it takes no --format\n");
+    exit(1);
+  }
+
+  if (cfg->probe && (!cfg->filename || cfg->bench)) {
+    fprintf(stderr, "--probe needs -f, and replaces --bench\n");
+    exit(1);
+  }
+
+  if (cfg->socket) {
+    if (cfg->filename || cfg->manifest || cfg->bench || cfg->start_at ||
+        cfg->sync_group) {
+      fprintf(stderr, "-d takes animations over its socket, not -f/-m/"
+                      "--start-at/--sync-group\n");
+      exit(1);
+    }
+    return;
+  }
+
+  if (!cfg->filename && !cfg->manifest) {
     fprintf(stderr, "GIF filename required (-f)\n");
     exit(1);
   }
@@ -0,0 +1,504 @@
+// accept4() and pipe2()
+#define _GNU_SOURCE
+
+#include "../include/daemon.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../include/anim.h"
+#include "../include/config.h"
+#include "../include/layout.h"
+
+#define NAME_MAX_LEN 64
+#define LINE_MAX_LEN 1024
+
+// replies a client may leave unread before it is dropped
+#define OUT_MAX_LEN (64 * 1024)
+
+// a decoded animation, addressable by name
+struct cached {
+  char name[NAME_MAX_LEN];
+  struct anim *anim;
+  struct cached *next;
+};
+
+struct client {
+  int fd;
+  char buf[LINE_MAX_LEN];
+  size_t len;
+
+  // replies the socket didn't take yet, sent once it is writable
+  char *out;
+  size_t out_len;
+  size_t out_cap;
+  int want_out; // watched for writability
+
+  struct client *next;
+};
+
+struct daemon {
+  struct engine *engine;
+  struct stream *player;
+  const char *path;
+  int listen_fd;
+
+  // how the player's animations are loaded, shared read-only with loader
+  // threads
+  uint32_t *map;
+  unsigned fps;
+  int compress;
+  enum pixel_format format;
+  int dither;
+
+  struct cached *cache;
+  struct client *clients;
+
+  // loader threads hand finished jobs back through this pipe, so the
+  // cache is only ever touched from the event loop
+  int done_pipe[2];
+  int loads_pending;
+};
+
+struct load_job {
+  struct daemon *d;
+  char name[NAME_MAX_LEN];
+  char *path;
+  struct anim *anim; // NULL if decoding failed
+};
+
+static struct cached *cache_find(struct daemon *d, const char *name) {
+  for (struct cached *c = d->cache; c; c = c->next)
+    if (strcmp(c->name, name) == 0)
+      return c;
+  return NULL;
+}
+
+static const char *cache_name_of(struct daemon *d, const struct anim *a) {
+  for (struct cached *c = d->cache; c; c = c->next)
+    if (c->anim == a)
+      return c->name;
+  return "-";
+}
+
+static void cache_drop(struct daemon *d, const char *name) {
+  for (struct cached **p = &d->cache; *p; p = &(*p)->next) {
+    if (strcmp((*p)->name, name) == 0) {
+      struct cached *c = *p;
+      *p = c->next;
+      // a player still holding it keeps its own reference
+      anim_release(c->anim);
+      free(c);
+      return;
+    }
+  }
+}
+
+static void *load_thread(void *arg) {
+  struct load_job *job = (struct load_job *)arg;
+
+  // full brightness and no power limit; the player scales and limits
+  // at send time, knowing the brightness
+  struct extract_opts opts = {.brightness = 1.0f,
+                              .width = MATRIX_WIDTH,
+                              .height = MATRIX_HEIGHT,
+                              .map = job->d->map,
+                              .led_count = NUM_LEDS,
+                              .fps = job->d->fps,
+                              .compress = job->d->compress,
+                              .format = job->d->dither ? PIXEL_RGB16
+                                                       : job->d->format};
+  job->anim = anim_load(job->path, &opts);
+  if (job->anim && anim_sum_channels(job->anim) != 0) {
+    anim_release(job->anim);
+    job->anim = NULL;
+  }
+
+  // pointer-sized writes to a pipe are atomic
+  ssize_t w;
+  do {
+    w = write(job->d->done_pipe[1], &job, sizeof(job));
+  } while (w < 0 && errno == EINTR);
+
+  return NULL;
+}
+
+// a finished load, back on the event loop
+static void load_done(struct daemon *d, struct load_job *job) {
+  d->loads_pending -= 1;
+
+  if (job->anim) {
+    cache_drop(d, job->name);
+
+    struct cached *c = (struct cached *)calloc(1, sizeof(*c));
+    if (c) {
+      memcpy(c->name, job->name, sizeof(c->name));
+      c->anim = job->anim;
+      c->next = d->cache;
+      d->cache = c;
+    } else {
+      anim_release(job->anim);
+    }
+  } else {
+    fprintf(stderr, "load %s failed: %s\n", job->name, job->path);
+  }
+
+  free(job->path);
+  free(job);
+}
+
+static void on_load_done(struct engine *e, int fd, void *ctx) {
+  (void)e;
+  struct load_job *job;
+
+  while (read(fd, &job, sizeof(job)) == (ssize_t)sizeof(job))
+    load_done((struct daemon *)ctx, job);
+}
+
+static int start_load(struct daemon *d, const char *name, const char *path) {
+  struct load_job *job = (struct load_job *)calloc(1, sizeof(*job));
+  if (!job)
+    return -1;
+
+  job->d = d;
+  snprintf(job->name, sizeof(job->name), "%s", name);
+  job->path = strdup(path);
+
+  pthread_t tid;
+  if (!job->path || pthread_create(&tid, NULL, load_thread, job) != 0) {
+    free(job->path);
+    free(job);
+    return -1;
+  }
+
+  pthread_detach(tid);
+  d->loads_pending += 1;
+  return 0;
+}
+
+// runs one command line, writing the reply into out
+static void handle_command(struct daemon *d, char *line, char *out,
+                           size_t out_len) {
+  char *save = NULL;
+  char *cmd = strtok_r(line, " \t\r", &save);
+  char *arg1 = strtok_r(NULL, " \t\r", &save);
+  char *arg2 = strtok_r(NULL, " \t\r", &save);
+
+  if (!cmd) {
+    snprintf(out, out_len, "error: empty command\n");
+    return;
+  }
+
+  if (strcmp(cmd, "load") == 0 && arg1 && arg2) {
+    if (strlen(arg1) >= NAME_MAX_LEN)
+      snprintf(out, out_len, "error: name too long\n");
+    else if (start_load(d, arg1, arg2) != 0)
+      snprintf(out, out_len, "error: failed to start load\n");
+    else
+      snprintf(out, out_len, "ok loading %s\n", arg1);
+  } else if ((strcmp(cmd, "play") == 0 || strcmp(cmd, "queue") == 0) &&
+             arg1) {
+    struct cached *c = cache_find(d, arg1);
+    if (!c) {
+      snprintf(out, out_len, "error: not loaded: %s\n", arg1);
+    } else if (cmd[0] == 'p') {
+      player_play(d->engine, d->player, c->anim);
+      snprintf(out, out_len, "ok\n");
+    } else if (player_queue(d->engine, d->player, c->anim) == 0) {
+      snprintf(out, out_len, "ok\n");
+    } else {
+      snprintf(out, out_len, "error: out of memory\n");
+    }
+  } else if (strcmp(cmd, "stop") == 0) {
+    player_stop(d->player);
+    snprintf(out, out_len, "ok\n");
+  } else if (strcmp(cmd, "brightness") == 0 && arg1) {
+    char *end;
+    float br = strtof(arg1, &end);
+    if (end == arg1 || br < 0.0f || br > 1.0f) {
+      snprintf(out, out_len, "error: invalid brightness: %s (0.0-1.0)\n",
+               arg1);
+    } else {
+      player_set_brightness(d->player, br);
+      snprintf(out, out_len, "ok\n");
+    }
+  } else if (strcmp(cmd, "unload") == 0 && arg1) {
+    cache_drop(d, arg1);
+    snprintf(out, out_len, "ok\n");
+  } else if (strcmp(cmd, "stats") == 0) {
+    struct player_stats st;
+    player_get_stats(d->player, &st);
+
+    size_t cached = 0;
+    for (struct cached *c = d->cache; c; c = c->next)
+      cached += 1;
+
+    snprintf(out, out_len,
+             "playing=%s frame=%zu loops=%d queued=%zu sent=%llu late=%llu "
+             "limited=%llu brightness=%.2f cached=%zu loading=%d\n",
+             st.anim ? cache_name_of(d, st.anim) : "-", st.frame, st.loops,
+             st.queued, (unsigned long long)st.frames_sent,
+             (unsigned long long)st.late_frames,
+             (unsigned long long)st.limited_frames, st.brightness, cached,
+             d->loads_pending);
+  } else {
+    snprintf(out, out_len, "error: unknown command: %s\n", cmd);
+  }
+}
+
+static void client_close(struct daemon *d, struct client *cl) {
+  engine_unwatch(d->engine, cl->fd);
+  close(cl->fd);
+
+  for (struct client **p = &d->clients; *p; p = &(*p)->next) {
+    if (*p == cl) {
+      *p = cl->next;
+      break;
+    }
+  }
+  free(cl->out);
+  free(cl);
+}
+
+// queues a reply. returns -1 if the client left too much unread.
+static int client_reply(struct client *cl, const char *msg) {
+  size_t len = strlen(msg);
+  if (cl->out_len + len > OUT_MAX_LEN)
+    return -1;
+
+  if (cl->out_len + len > cl->out_cap) {
+    size_t cap = cl->out_cap ? cl->out_cap : 512;
+    while (cap < cl->out_len + len)
+      cap *= 2;
+    char *out = (char *)realloc(cl->out, cap);
+    if (!out)
+      return -1;
+    cl->out = out;
+    cl->out_cap = cap;
+  }
+
+  memcpy(cl->out + cl->out_len, msg, len);
+  cl->out_len += len;
+  return 0;
+}
+
+// writes as much queued output as the socket takes; the event loop calls
+// back for the rest once it is writable. returns 0, or -1 if the client
+// is gone.
+static int client_flush(struct daemon *d, struct client *cl) {
+  size_t sent = 0;
+  while (sent < cl->out_len) {
+    ssize_t n = write(cl->fd, cl->out + sent, cl->out_len - sent);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0 && errno == EAGAIN)
+      break;
+    if (n <= 0)
+      return -1;
+    sent += (size_t)n;
+  }
+
+  if (sent > 0) {
+    cl->out_len -= sent;
+    memmove(cl->out, cl->out + sent, cl->out_len);
+  }
+
+  int want = cl->out_len > 0;
+  if (want != cl->want_out) {
+    if (engine_watch_writable(d->engine, cl->fd, want) != 0)
+      return -1;
+    cl->want_out = want;
+  }
+  return 0;
+}
+
+static void on_client(struct engine *e, int fd, void *ctx) {
+  (void)e;
+  struct daemon *d = (struct daemon *)ctx;
+
+  struct client *cl = d->clients;
+  while (cl && cl->fd != fd)
+    cl = cl->next;
+  if (!cl)
+    return;
+
+  // woken up for writing, or reading: either way send what is queued
+  if (client_flush(d, cl) != 0) {
+    client_close(d, cl);
+    return;
+  }
+
+  ssize_t n = read(fd, cl->buf + cl->len, sizeof(cl->buf) - 1 - cl->len);
+  if (n < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+  if (n <= 0) {
+    client_close(d, cl);
+    return;
+  }
+  cl->len += (size_t)n;
+
+  // run every complete line, keep the rest for the next read
+  char *start = cl->buf;
+  char *nl;
+  while ((nl = memchr(start, '\n', cl->len - (size_t)(start - cl->buf)))) {
+    *nl = '\0';
+
+    char reply[512];
+    handle_command(d, start, reply, sizeof(reply));
+    if (client_reply(cl, reply) != 0) {
+      client_close(d, cl);
+      return;
+    }
+
+    start = nl + 1;
+  }
+
+  cl->len -= (size_t)(start - cl->buf);
+  memmove(cl->buf, start, cl->len);
+
+  // the error is sent best effort, the client is dropped either way
+  if (cl->len == sizeof(cl->buf) - 1) {
+    client_reply(cl, "error: line too long\n");
+    client_flush(d, cl);
+    client_close(d, cl);
+    return;
+  }
+
+  if (client_flush(d, cl) != 0)
+    client_close(d, cl);
+}
+
+static void on_accept(struct engine *e, int fd, void *ctx) {
+  struct daemon *d = (struct daemon *)ctx;
+
+  int cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (cfd < 0)
+    return;
+
+  struct client *cl = (struct client *)calloc(1, sizeof(*cl));
+  if (!cl || engine_watch(e, cfd, on_client, d) != 0) {
+    free(cl);
+    close(cfd);
+    return;
+  }
+
+  cl->fd = cfd;
+  cl->next = d->clients;
+  d->clients = cl;
+}
+
+static int open_socket(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "socket path too long: %s\n", path);
+    return -1;
+  }
+  memcpy(addr.sun_path, path, strlen(path) + 1);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+
+  // a stale socket from an earlier run would make bind fail
+  unlink(path);
+
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 8) != 0) {
+    fprintf(stderr, "failed to listen on %s: %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+struct daemon *daemon_start(struct engine *e, const Config *cfg) {
+  struct daemon *d = (struct daemon *)calloc(1, sizeof(*d));
+  if (!d)
+    return NULL;
+
+  d->engine = e;
+  d->path = cfg->socket;
+  d->listen_fd = -1;
+  d->done_pipe[0] = d->done_pipe[1] = -1;
+  d->fps = cfg->fps;
+  d->compress = cfg->compress;
+  d->format = cfg->format;
+  d->dither = cfg->dither;
+
+  if (cfg->wiring && *cfg->wiring) {
+    d->map = layout_compile(cfg->wiring, MATRIX_WIDTH, MATRIX_HEIGHT);
+    if (!d->map)
+      goto fail;
+  }
+
+  d->player = engine_add_player(e, cfg->output, 0, cfg->format,
+                                cfg->dither);
+  if (!d->player)
+    goto fail;
+  player_set_brightness(d->player, cfg->brightness);
+  player_set_power(d->player,
+                   &(struct power_opts){.budget_ma = cfg->power_budget_ma,
+                                        .channel_ma = cfg->channel_ma,
+                                        .idle_ma = LED_IDLE_MA});
+
+  if (pipe2(d->done_pipe, O_NONBLOCK | O_CLOEXEC) != 0)
+    goto fail;
+
+  d->listen_fd = open_socket(cfg->socket);
+  if (d->listen_fd < 0)
+    goto fail;
+
+  if (engine_watch(e, d->done_pipe[0], on_load_done, d) != 0 ||
+      engine_watch(e, d->listen_fd, on_accept, d) != 0)
+    goto fail;
+
+  fprintf(stderr, "listening on %s\n", cfg->socket);
+  return d;
+
+fail:
+  daemon_stop(d);
+  return NULL;
+}
+
+void daemon_stop(struct daemon *d) {
+  if (!d)
+    return;
+
+  // loader threads still write to the pipe; wait them out
+  if (d->done_pipe[0] >= 0) {
+    int flags = fcntl(d->done_pipe[0], F_GETFL);
+    fcntl(d->done_pipe[0], F_SETFL, flags & ~O_NONBLOCK);
+
+    struct load_job *job;
+    while (d->loads_pending > 0 &&
+           read(d->done_pipe[0], &job, sizeof(job)) == (ssize_t)sizeof(job))
+      load_done(d, job);
+
+    engine_unwatch(d->engine, d->done_pipe[0]);
+    close(d->done_pipe[0]);
+    close(d->done_pipe[1]);
+  }
+
+  while (d->clients)
+    client_close(d, d->clients);
+
+  if (d->listen_fd >= 0) {
+    engine_unwatch(d->engine, d->listen_fd);
+    close(d->listen_fd);
+    unlink(d->path);
+  }
+
+  while (d->cache)
+    cache_drop(d, d->cache->name);
+
+  free(d->map);
+  free(d);
+}
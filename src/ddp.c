@@ -6,12 +6,7 @@
 #include <string.h>
 #include <sys/types.h>
 
-uint8_t *ddp_header_serialize(const struct ddp_header *header) {
-  uint8_t *buf = (uint8_t *)malloc(DDP_HEADER_SIZE);
-
-  if (!buf)
-    return NULL;
-
+void ddp_header_write(const struct ddp_header *header, uint8_t *buf) {
   buf[0] = header->flags;
   buf[1] = header->res1;
   buf[2] = header->type;
@@ -22,7 +17,37 @@ uint8_t *ddp_header_serialize(const struct ddp_header *header) {
 
   memcpy(buf + 4, &off, 4);
   memcpy(buf + 8, &len, 2);
+}
+
+int ddp_header_parse(const uint8_t *buf, size_t len,
+                     struct ddp_header *header) {
+  if (len < DDP_HEADER_SIZE || (buf[0] & DDP_VER_MASK) != DDP_FLAG_VER1)
+    return -1;
+
+  header->flags = buf[0];
+  header->res1 = buf[1];
+  header->type = buf[2];
+  header->res2 = buf[3];
+
+  uint32_t off;
+  uint16_t dlen;
+  memcpy(&off, buf + 4, 4);
+  memcpy(&dlen, buf + 8, 2);
+  header->offset = ntohl(off);
+  header->length = ntohs(dlen);
+
+  // the timecode is skipped, nothing here uses it
+  int size = DDP_HEADER_SIZE + (buf[0] & DDP_FLAG_TIME ? 4 : 0);
+  return len < (size_t)size ? -1 : size;
+}
+
+uint8_t *ddp_header_serialize(const struct ddp_header *header) {
+  uint8_t *buf = (uint8_t *)malloc(DDP_HEADER_SIZE);
+
+  if (!buf)
+    return NULL;
 
+  ddp_header_write(header, buf);
   return buf; // 10 byte
 }
 
@@ -0,0 +1,1081 @@
+#include "../include/engine.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "../include/anim.h"
+#include "../include/clock.h"
+#include "../include/config.h"
+#include "../include/ddp.h"
+#include "../include/layout.h"
+#include "../include/output.h"
+#include "../include/wall.h"
+
+#define MAX_EVENTS 16
+
+// one output of a stream: a controller and the part of the frame it gets
+struct target {
+  struct sink *sink;
+  struct ddp_header header; // type and base offset, flags set per packet
+  size_t data_off;          // slice of the frame this target gets, in bytes
+  size_t len;
+};
+
+struct stream {
+  struct anim *anim;
+  struct target *targets;
+  size_t target_count;
+
+  size_t cur_frame;
+  int loops_done;
+  int loop_count; // -1 = infinite
+
+  uint64_t deadline; // monotonic ns of the next frame
+  int in_heap;
+  size_t id; // order streams were added in
+
+  uint64_t frames_sent;
+  uint64_t late_frames;    // deadlines missed by more than a frame
+  uint64_t limited_frames; // scaled down at send time, see power
+
+  // players (daemon mode) outlive their animations. commands only set
+  // the fields below; they are applied by the next frame boundary.
+  int player;
+  struct anim *next_anim; // switch to this at the next frame
+  int stop_pending;       // blank and go idle at the next frame
+  struct anim **queue;    // played in turn at the end of a loop
+  size_t queue_len;
+  size_t queue_cap;
+
+  enum pixel_format format; // of the frames, not always of the wire
+
+  // dithered streams send rgb from rgb16 frames, one phase per packet
+  int dither;
+  unsigned dither_phase;
+  uint8_t *dither_thr; // DITHER_PHASES rows, see pixel_dither_thresholds()
+  uint8_t *dithered;   // the frame being sent
+
+  // while held, a dithered frame is resent every dither_tick ns until it
+  // is due to end, see dither_hold()
+  uint64_t dither_tick;
+  int holding;
+  uint64_t frame_due;
+
+  // brightness applied at send time, post-gamma. 8 bit channels go
+  // through a table, 16 bit ones are multiplied by a 16.16 factor.
+  float brightness;
+  int scaled;
+  uint8_t scale_lut[4][256];
+  uint32_t scale_k[4];
+  uint8_t *scratch; // one frame, for scaled and blank frames
+
+  // a player's power budget, checked against the frame as scaled. other
+  // streams' frames are limited when they are sampled.
+  struct power_opts power;
+
+  // compressed animations are decoded here, and sent from here
+  struct frame_cursor cursor;
+
+  // synced streams follow a timeline shared with other instances
+  int synced;
+  int64_t epoch_ns;   // wall-clock start of loop 0
+  int64_t epoch_mono; // epoch_ns on the monotonic clock, as last mapped
+  uint64_t period_ns; // one loop
+  int join_loops;     // loops count from joining
+  int joined;
+  uint64_t loop_base; // loops of the timeline before joining
+};
+
+// a file descriptor serviced by the event loop
+struct watch {
+  int fd;
+  engine_fd_cb cb;
+  void *ctx;
+  struct watch *next;
+};
+
+struct engine {
+  int epfd;
+  int tfd;
+  int sfd; // SIGINT/SIGTERM, for a clean shutdown
+
+  // wall bursts: time from the first to the last PUSH of a frame
+  uint64_t bursts;
+  uint64_t burst_ns_total;
+  uint64_t burst_ns_max;
+
+  // min-heap of active streams ordered by deadline
+  struct stream **heap;
+  size_t count;
+  size_t cap;
+  size_t added; // streams ever added, for their ids
+
+  struct watch *watches;
+
+  // players are owned here while idle, i.e. out of the heap
+  struct stream **players;
+  size_t player_count;
+};
+
+static void heap_swap(struct engine *e, size_t a, size_t b) {
+  struct stream *t = e->heap[a];
+  e->heap[a] = e->heap[b];
+  e->heap[b] = t;
+}
+
+static void heap_up(struct engine *e, size_t i) {
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+    if (e->heap[parent]->deadline <= e->heap[i]->deadline)
+      break;
+    heap_swap(e, i, parent);
+    i = parent;
+  }
+}
+
+static void heap_down(struct engine *e, size_t i) {
+  for (;;) {
+    size_t l = 2 * i + 1;
+    size_t r = l + 1;
+    size_t min = i;
+
+    if (l < e->count && e->heap[l]->deadline < e->heap[min]->deadline)
+      min = l;
+    if (r < e->count && e->heap[r]->deadline < e->heap[min]->deadline)
+      min = r;
+    if (min == i)
+      break;
+
+    heap_swap(e, i, min);
+    i = min;
+  }
+}
+
+static void stream_free(struct stream *s) {
+  for (size_t i = 0; i < s->target_count; i++)
+    sink_close(s->targets[i].sink);
+  free(s->targets);
+  anim_release(s->anim);
+  anim_release(s->next_anim);
+  for (size_t i = 0; i < s->queue_len; i++)
+    anim_release(s->queue[i]);
+  free(s->queue);
+  free(s->scratch);
+  free(s->dither_thr);
+  free(s->dithered);
+  frame_cursor_free(&s->cursor);
+  free(s);
+}
+
+// removes the heap top
+static void heap_pop(struct engine *e) {
+  e->count -= 1;
+  if (e->count > 0) {
+    e->heap[0] = e->heap[e->count];
+    heap_down(e, 0);
+  }
+}
+
+struct engine *engine_create(void) {
+  struct engine *e = (struct engine *)calloc(1, sizeof(*e));
+  if (!e)
+    return NULL;
+
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+
+  e->epfd = epoll_create1(EPOLL_CLOEXEC);
+  e->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  e->sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (e->epfd < 0 || e->tfd < 0 || e->sfd < 0) {
+    fprintf(stderr, "failed to create event loop: %s\n", strerror(errno));
+    engine_destroy(e);
+    return NULL;
+  }
+
+  struct epoll_event ev = {.events = EPOLLIN, .data.fd = e->tfd};
+  struct epoll_event sev = {.events = EPOLLIN, .data.fd = e->sfd};
+  if (epoll_ctl(e->epfd, EPOLL_CTL_ADD, e->tfd, &ev) != 0 ||
+      epoll_ctl(e->epfd, EPOLL_CTL_ADD, e->sfd, &sev) != 0) {
+    fprintf(stderr, "failed to watch timer: %s\n", strerror(errno));
+    engine_destroy(e);
+    return NULL;
+  }
+
+  return e;
+}
+
+// makes room for one more stream in the heap
+static int engine_reserve(struct engine *e) {
+  if (e->count < e->cap)
+    return 0;
+
+  size_t cap = e->cap ? e->cap * 2 : 8;
+  struct stream **heap =
+      (struct stream **)realloc(e->heap, cap * sizeof(*heap));
+  if (!heap)
+    return -1;
+
+  e->heap = heap;
+  e->cap = cap;
+  return 0;
+}
+
+// what goes on the wire
+static enum pixel_format wire_format(const struct stream *s) {
+  return s->dither ? PIXEL_RGB8 : s->format;
+}
+
+// the thresholds are computed once, so dithering a packet is one pass
+static int stream_set_dither(struct stream *s, size_t led_count, int hz) {
+  s->dither = 1;
+  s->dither_tick = NS_PER_SEC / (uint64_t)hz;
+  s->dither_thr = (uint8_t *)malloc(DITHER_PHASES * led_count * 3);
+  s->dithered = (uint8_t *)malloc(led_count * 3);
+  if (!s->dither_thr || !s->dithered)
+    return -1;
+
+  pixel_dither_thresholds(led_count, s->dither_thr);
+  return 0;
+}
+
+static struct stream *stream_create(const char *gif, int width, int height,
+                                    const uint32_t *map, size_t led_count,
+                                    size_t target_count,
+                                    const struct play_opts *play) {
+  struct extract_opts opts = {.brightness = play->brightness,
+                              .width = width,
+                              .height = height,
+                              .map = map,
+                              .led_count = led_count,
+                              .power = play->power,
+                              .fps = play->fps,
+                              .compress = play->compress,
+                              .format = play->dither ? PIXEL_RGB16
+                                                     : play->format};
+
+  // with a single loop left, frames before the start are never shown, so
+  // they are not even decoded. resampled frames only exist after the whole
+  // gif is decoded, so there the start is found afterwards.
+  // synced streams only find their first frame once they are ready.
+  // only such a start reads keyframes back, so the seek cache is left
+  // closed otherwise.
+  int one_shot = play->loop_count >= 0 &&
+                 play->loop_count - play->loops_done == 1 && !play->fps &&
+                 !play->synced;
+  if (one_shot) {
+    opts.first_frame = play->start_frame;
+    opts.start_ms = play->start_ms;
+    opts.seek_cache = play->seek_cache;
+  }
+
+  struct stream *s = (struct stream *)calloc(1, sizeof(*s));
+  if (!s)
+    return NULL;
+
+  s->targets = (struct target *)calloc(target_count, sizeof(*s->targets));
+  s->anim = s->targets ? anim_acquire(gif, &opts) : NULL;
+  if (!s->anim) {
+    free(s->targets);
+    free(s);
+    return NULL;
+  }
+
+  // the same check extraction makes for a one-shot start
+  const struct anim *a = s->anim;
+  if (!one_shot) {
+    if (play->start_ms > 0) {
+      s->cur_frame =
+          frame_at_ms(a->delays_in_ms, a->frame_count, play->start_ms);
+    } else if (play->start_frame >= a->frame_count) {
+      fprintf(stderr, "start frame %zu out of range (%zu frames)\n",
+              play->start_frame, a->frame_count);
+      anim_release(s->anim);
+      free(s->targets);
+      free(s);
+      return NULL;
+    } else {
+      s->cur_frame = play->start_frame;
+    }
+  }
+
+  s->loop_count = play->loop_count;
+  s->loops_done = play->loops_done;
+  s->format = opts.format;
+  if (play->dither && stream_set_dither(s, led_count, play->dither) != 0) {
+    stream_free(s);
+    return NULL;
+  }
+
+  if (play->synced) {
+    s->synced = 1;
+    s->epoch_ns = play->epoch_ns;
+    s->join_loops = play->join_loops;
+    for (size_t i = 0; i < a->frame_count; i++)
+      s->period_ns += a->delays_in_ms[i] * NS_PER_MS;
+  }
+  return s;
+}
+
+// points target i at output, sending led_count LEDs of the frame starting
+// at LED first. frames are already in wire order, so a target is a slice.
+static int stream_set_target(struct stream *s, size_t i, const char *output,
+                             uint32_t offset, size_t first,
+                             size_t led_count) {
+  struct target *t = &s->targets[i];
+  s->target_count = i + 1;
+
+  t->sink = sink_open(output);
+  if (!t->sink)
+    return -1;
+
+  t->header.type = pixel_ddp_type(wire_format(s));
+  t->header.offset = offset;
+  t->data_off = first * pixel_size(wire_format(s));
+  t->len = led_count * pixel_size(wire_format(s));
+  return 0;
+}
+
+int engine_add_stream(struct engine *e, const char *gif, const char *output,
+                      uint32_t offset, const char *layout,
+                      const struct play_opts *play) {
+  if (engine_reserve(e) != 0)
+    return -1;
+
+  // plain row-major wiring needs no table
+  uint32_t *map = NULL;
+  if (layout && *layout) {
+    map = layout_compile(layout, MATRIX_WIDTH, MATRIX_HEIGHT);
+    if (!map)
+      return -1;
+  }
+
+  struct stream *s = stream_create(gif, MATRIX_WIDTH, MATRIX_HEIGHT, map,
+                                   NUM_LEDS, 1, play);
+  free(map);
+  if (!s)
+    return -1;
+
+  if (stream_set_target(s, 0, output, offset, 0, NUM_LEDS) != 0) {
+    stream_free(s);
+    return -1;
+  }
+
+  s->id = e->added++;
+  e->heap[e->count] = s;
+  e->count += 1;
+  return 0;
+}
+
+// wire order of a whole wall: every controller's rectangle in turn, each
+// in its own wiring, translated to wall grid indices
+static uint32_t *wall_compile(const struct wall *w, size_t *led_count) {
+  size_t total = 0;
+  for (size_t i = 0; i < w->count; i++)
+    total += (size_t)w->regions[i].w * w->regions[i].h;
+
+  uint32_t *map = (uint32_t *)malloc(total * sizeof(*map));
+  if (!map)
+    return NULL;
+
+  size_t n = 0;
+  for (size_t i = 0; i < w->count; i++) {
+    const struct wall_region *r = &w->regions[i];
+    uint32_t *local = layout_compile(r->layout, r->w, r->h);
+    if (!local) {
+      free(map);
+      return NULL;
+    }
+
+    for (size_t j = 0; j < (size_t)r->w * r->h; j++) {
+      uint32_t x = local[j] % r->w;
+      uint32_t y = local[j] / r->w;
+      map[n++] = (uint32_t)(r->y + y) * w->width + r->x + x;
+    }
+    free(local);
+  }
+
+  *led_count = total;
+  return map;
+}
+
+int engine_add_wall(struct engine *e, const char *gif, const char *layout,
+                    const struct play_opts *play) {
+  if (engine_reserve(e) != 0)
+    return -1;
+
+  struct wall *w = wall_load(layout);
+  if (!w)
+    return -1;
+
+  size_t led_count = 0;
+  uint32_t *map = wall_compile(w, &led_count);
+  struct stream *s =
+      map ? stream_create(gif, w->width, w->height, map, led_count, w->count,
+                          play)
+          : NULL;
+  free(map);
+  if (!s) {
+    wall_free(w);
+    return -1;
+  }
+
+  size_t first = 0;
+  for (size_t i = 0; i < w->count; i++) {
+    const struct wall_region *r = &w->regions[i];
+    size_t n = (size_t)r->w * r->h;
+    if (stream_set_target(s, i, r->output, r->offset, first, n) != 0) {
+      stream_free(s);
+      wall_free(w);
+      return -1;
+    }
+    first += n;
+  }
+
+  wall_free(w);
+  s->id = e->added++;
+  e->heap[e->count] = s;
+  e->count += 1;
+  return 0;
+}
+
+int engine_add_manifest(struct engine *e, const char *path,
+                        const struct play_opts *play) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    fprintf(stderr, "failed to open manifest %s: %s\n", path,
+            strerror(errno));
+    return -1;
+  }
+
+  char line[1024];
+  int line_no = 0;
+  int ret = 0;
+
+  while (ret == 0 && fgets(line, sizeof(line), fp)) {
+    line_no += 1;
+
+    char *p = line;
+    while (isspace((unsigned char)*p))
+      p++;
+    if (*p == '\0' || *p == '#')
+      continue;
+
+    char gif[512], output[512] = "-", layout[512] = "";
+    unsigned long offset = 0;
+    int n = sscanf(p, "%511s %511s %lu %511s", gif, output, &offset, layout);
+    if (n < 1 || offset > UINT32_MAX) {
+      fprintf(stderr, "%s:%d: expected <gif> [output] [offset] [layout]\n",
+              path, line_no);
+      ret = -1;
+      break;
+    }
+
+    ret = engine_add_stream(e, gif, output, (uint32_t)offset, layout, play);
+  }
+
+  fclose(fp);
+  return ret;
+}
+
+static void arm_timer(struct engine *e) {
+  struct itimerspec its = {0};
+
+  // an all-zero value disarms the timer once no stream is left
+  if (e->count > 0) {
+    uint64_t d = e->heap[0]->deadline;
+    its.it_value.tv_sec = (time_t)(d / NS_PER_SEC);
+    its.it_value.tv_nsec = (long)(d % NS_PER_SEC);
+  }
+
+  timerfd_settime(e->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static int stream_send(struct engine *e, struct stream *s,
+                       const uint8_t *frame) {
+  // with several controllers, data goes out first without PUSH and every
+  // controller is then latched back to back, so all segments show the
+  // frame at the same moment
+  int push_each = s->target_count == 1;
+
+  for (size_t i = 0; i < s->target_count; i++) {
+    struct target *t = &s->targets[i];
+    if (sink_send_frame(t->sink, &t->header, frame + t->data_off, t->len,
+                        push_each) != 0)
+      return -1;
+  }
+
+  if (!push_each) {
+    uint64_t first = mono_ns();
+    for (size_t i = 0; i < s->target_count; i++)
+      if (sink_send_push(s->targets[i].sink, &s->targets[i].header) != 0)
+        return -1;
+    uint64_t span = mono_ns() - first;
+
+    e->bursts += 1;
+    e->burst_ns_total += span;
+    if (span > e->burst_ns_max)
+      e->burst_ns_max = span;
+  }
+
+  s->frames_sent += 1;
+  return 0;
+}
+
+// swaps in the animation a player was told to play
+static void player_switch(struct stream *s, struct anim *a) {
+  anim_release(s->anim);
+  s->anim = a;
+  s->cursor.fs = NULL; // a new animation may reuse the old one's memory
+  s->cur_frame = 0;
+  s->loops_done = 0;
+}
+
+// applies player commands at a frame boundary. returns 1 if there is a
+// frame to send, 0 if the player goes idle, -1 on output error.
+static int player_sync(struct engine *e, struct stream *s) {
+  if (s->stop_pending) {
+    s->stop_pending = 0;
+    anim_release(s->next_anim);
+    s->next_anim = NULL;
+    for (size_t i = 0; i < s->queue_len; i++)
+      anim_release(s->queue[i]);
+    s->queue_len = 0;
+
+    if (s->anim) {
+      player_switch(s, NULL);
+      memset(s->scratch, 0, s->targets[0].len);
+      if (stream_send(e, s, s->scratch) != 0)
+        return -1;
+    }
+    return 0;
+  }
+
+  if (s->next_anim) {
+    player_switch(s, s->next_anim);
+    s->next_anim = NULL;
+  }
+
+  return s->anim != NULL;
+}
+
+// applies a player's brightness and power budget to a frame. returns
+// what to send: scratch if either changed it, else the frame itself.
+// the channel sum of the current frame as stream_scale() dims it (frame),
+// from the sums stored at load. the tables round to nearest, so 8 bit
+// frames get half a level per channel on top; the sum is a bound, never
+// under. without stored sums, frame itself is summed.
+static uint64_t stream_sum(const struct stream *s, const uint8_t *frame,
+                           size_t len) {
+  const struct anim *a = s->anim;
+  if (!a->channel_sums)
+    return pixel_depth(s->format) == 2 ? power_channel_sum16(frame, len)
+                                       : power_channel_sum(frame, len);
+
+  const uint64_t *sums = a->channel_sums[s->cur_frame];
+  if (!s->scaled)
+    return sums[0] + sums[1] + sums[2] + sums[3];
+
+  // 16.16 factors are rounded down, so one more keeps the bound
+  uint64_t sum = 0;
+  for (int c = 0; c < 4; c++)
+    sum += (sums[c] * (s->scale_k[c] + 1) + 0xffff) >> 16;
+  return pixel_depth(s->format) == 2 ? sum : sum + (len + 1) / 2;
+}
+
+static const uint8_t *stream_scale(struct stream *s, const uint8_t *frame,
+                                   size_t len) {
+  if (s->scaled && pixel_depth(s->format) == 2) {
+    for (size_t i = 0; i + 1 < len; i += 2) {
+      uint32_t v = (uint32_t)frame[i] << 8 | frame[i + 1];
+      v = (v * s->scale_k[(i / 2) % 3]) >> 16;
+      s->scratch[i] = (uint8_t)(v >> 8);
+      s->scratch[i + 1] = (uint8_t)v;
+    }
+    frame = s->scratch;
+  } else if (s->scaled) {
+    size_t channels = pixel_channels(s->format);
+    for (size_t i = 0; i < len; i++)
+      s->scratch[i] = s->scale_lut[i % channels][frame[i]];
+    frame = s->scratch;
+  }
+
+  // the budget is for what is sent: a dimmed frame is only scaled further
+  // if it still draws too much
+  if (s->power.budget_ma) {
+    size_t led_count = len / pixel_size(s->format);
+    uint64_t sum = stream_sum(s, frame, len);
+    if (sum > power_budget_sum(led_count, s->format, &s->power)) {
+      if (frame != s->scratch) {
+        memcpy(s->scratch, frame, len);
+        frame = s->scratch;
+      }
+      power_limit_sum(s->scratch, len, led_count, s->format, sum, &s->power);
+      s->limited_frames += 1;
+    }
+  }
+
+  return frame;
+}
+
+// puts a synced stream on the frame its timeline is at now, due at that
+// frame's start, i.e. right away unless the epoch is still ahead. returns
+// 0 if its loops are over by then.
+static int stream_align(struct stream *s, uint64_t now) {
+  const struct anim *a = s->anim;
+  s->epoch_mono = realtime_to_mono_ns(s->epoch_ns);
+
+  uint64_t loops = 0;
+  uint64_t into = 0;
+  s->cur_frame = 0;
+  if ((int64_t)now <= s->epoch_mono) {
+    s->deadline = (uint64_t)s->epoch_mono;
+  } else {
+    uint64_t elapsed = (uint64_t)((int64_t)now - s->epoch_mono);
+    into = elapsed % s->period_ns;
+    loops = elapsed / s->period_ns;
+
+    uint64_t at = 0;
+    while (at + a->delays_in_ms[s->cur_frame] * NS_PER_MS <= into) {
+      at += a->delays_in_ms[s->cur_frame] * NS_PER_MS;
+      s->cur_frame += 1;
+    }
+    s->deadline = (uint64_t)((int64_t)now - (int64_t)(into - at));
+  }
+
+  // a group joined at any time counts only the whole loops it plays
+  if (s->join_loops && !s->joined)
+    s->loop_base = loops + (into > 0);
+  s->joined = 1;
+
+  // the loop in progress when a group joins counts as -1
+  int64_t played = (int64_t)loops - (int64_t)s->loop_base;
+  s->loops_done = played > INT_MAX ? INT_MAX
+                  : played < -1    ? -1
+                                   : (int)played;
+  return s->loop_count < 0 || s->loops_done < s->loop_count;
+}
+
+// whether the wall clock was stepped since a synced stream last mapped it
+static int stream_slipped(const struct stream *s) {
+  int64_t d = realtime_to_mono_ns(s->epoch_ns) - s->epoch_mono;
+  int64_t max = (int64_t)(SYNC_MAX_SLIP_MS * NS_PER_MS);
+  return d > max || d < -max;
+}
+
+// a dithered frame is sent again every tick while it shows, each time
+// against the next phase, so the phases cycle at the same rate however
+// long the frames are. returns 1 while the frame is held; once it is
+// over, the deadline is its end.
+static int dither_hold(struct stream *s, uint64_t delay, uint64_t now) {
+  if (!s->holding)
+    s->frame_due = s->deadline + delay;
+
+  // behind, ticks are skipped rather than sent in a burst
+  uint64_t tick = s->deadline + s->dither_tick;
+  if (tick <= now)
+    tick = now + s->dither_tick;
+
+  // a repeat that would show for under half a tick isn't worth sending
+  s->holding = tick + s->dither_tick / 2 <= s->frame_due;
+  s->deadline = s->holding ? tick : s->frame_due;
+  return s->holding;
+}
+
+// sends the current frame and advances. returns 1 while the stream has
+// frames left, 0 once it is done, -1 on output error.
+static int stream_step(struct engine *e, struct stream *s, uint64_t now) {
+  // player commands wait for the frame being held to end
+  if (s->player && !s->holding) {
+    int r = player_sync(e, s);
+    if (r <= 0)
+      return r;
+  }
+
+  const struct anim *a = s->anim;
+  const uint8_t *frame = anim_frame(a, s->cur_frame, &s->cursor);
+  if (!frame)
+    return -1;
+
+  if (s->player)
+    frame = stream_scale(s, frame, a->frame_size);
+
+  if (s->dither) {
+    size_t n = a->frame_size / 2;
+    pixel_dither(frame, s->dither_thr + s->dither_phase * n, n, s->dithered);
+    s->dither_phase = (s->dither_phase + 1) % DITHER_PHASES;
+    frame = s->dithered;
+  }
+
+  if (stream_send(e, s, frame) != 0)
+    return -1;
+
+  // deadlines are absolute, so per-frame overhead doesn't accumulate
+  uint64_t delay = a->delays_in_ms[s->cur_frame] * NS_PER_MS;
+  if (!s->dither)
+    s->deadline += delay;
+  else if (dither_hold(s, delay, now))
+    return 1;
+
+  // if we fell more than a frame behind, resync rather than burst. synced
+  // streams skip ahead to where the others are.
+  if (s->deadline <= now) {
+    s->late_frames += 1;
+    if (s->synced)
+      return stream_align(s, now);
+    s->deadline = now + delay;
+  }
+
+  s->cur_frame += 1;
+  if (s->cur_frame == a->frame_count) {
+    s->cur_frame = 0;
+    s->loops_done += 1;
+
+    // a player moves on to its queue at the end of a loop
+    if (s->player && s->queue_len > 0 && !s->next_anim) {
+      player_switch(s, s->queue[0]);
+      s->queue_len -= 1;
+      memmove(s->queue, s->queue + 1, s->queue_len * sizeof(*s->queue));
+    }
+
+    if (s->loop_count >= 0 && s->loops_done >= s->loop_count)
+      return 0;
+
+    if (s->synced && stream_slipped(s))
+      return stream_align(s, now);
+  }
+
+  return 1;
+}
+
+// services every stream whose deadline has passed
+static int engine_fire(struct engine *e) {
+  uint64_t now = mono_ns();
+
+  while (e->count > 0 && e->heap[0]->deadline <= now) {
+    struct stream *s = e->heap[0];
+    int r = stream_step(e, s, now);
+
+    if (r < 0)
+      return -1;
+
+    if (r == 0) {
+      heap_pop(e);
+      s->in_heap = 0;
+      // idle players stay around for the next command
+      if (!s->player)
+        stream_free(s);
+    } else {
+      heap_down(e, 0);
+    }
+  }
+
+  arm_timer(e);
+  return 0;
+}
+
+int engine_watch(struct engine *e, int fd, engine_fd_cb cb, void *ctx) {
+  struct watch *w = (struct watch *)calloc(1, sizeof(*w));
+  if (!w)
+    return -1;
+
+  struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+  if (epoll_ctl(e->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    fprintf(stderr, "failed to watch fd %d: %s\n", fd, strerror(errno));
+    free(w);
+    return -1;
+  }
+
+  w->fd = fd;
+  w->cb = cb;
+  w->ctx = ctx;
+  w->next = e->watches;
+  e->watches = w;
+  return 0;
+}
+
+void engine_unwatch(struct engine *e, int fd) {
+  for (struct watch **p = &e->watches; *p; p = &(*p)->next) {
+    if ((*p)->fd == fd) {
+      struct watch *w = *p;
+      *p = w->next;
+      epoll_ctl(e->epfd, EPOLL_CTL_DEL, fd, NULL);
+      free(w);
+      return;
+    }
+  }
+}
+
+int engine_watch_writable(struct engine *e, int fd, int on) {
+  struct epoll_event ev = {.events = EPOLLIN | (on ? EPOLLOUT : 0u),
+                           .data.fd = fd};
+  return epoll_ctl(e->epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+struct stream *engine_add_player(struct engine *e, const char *output,
+                                 uint32_t offset, enum pixel_format format,
+                                 int dither) {
+  struct stream **players = (struct stream **)realloc(
+      e->players, (e->player_count + 1) * sizeof(*players));
+  if (!players)
+    return NULL;
+  e->players = players;
+
+  struct stream *s = (struct stream *)calloc(1, sizeof(*s));
+  if (!s)
+    return NULL;
+
+  s->format = dither ? PIXEL_RGB16 : format;
+  s->targets = (struct target *)calloc(1, sizeof(*s->targets));
+  s->scratch = (uint8_t *)malloc(NUM_LEDS * pixel_size(s->format));
+  if (!s->targets || !s->scratch ||
+      (dither && stream_set_dither(s, NUM_LEDS, dither) != 0) ||
+      stream_set_target(s, 0, output, offset, 0, NUM_LEDS) != 0) {
+    stream_free(s);
+    return NULL;
+  }
+
+  s->player = 1;
+  s->loop_count = -1;
+  s->brightness = 1.0f;
+
+  e->players[e->player_count] = s;
+  e->player_count += 1;
+  return s;
+}
+
+void player_play(struct engine *e, struct stream *s, struct anim *a) {
+  a->refs += 1;
+  anim_release(s->next_anim);
+  s->next_anim = a;
+  s->stop_pending = 0;
+
+  // an idle player starts right away, a busy one switches at its next
+  // deadline, which is at most one frame away
+  if (!s->in_heap && engine_reserve(e) == 0) {
+    s->deadline = mono_ns();
+    s->in_heap = 1;
+    e->heap[e->count] = s;
+    e->count += 1;
+    heap_up(e, e->count - 1);
+    arm_timer(e);
+  }
+}
+
+int player_queue(struct engine *e, struct stream *s, struct anim *a) {
+  // nothing playing: queueing is just playing
+  if (!s->in_heap) {
+    player_play(e, s, a);
+    return 0;
+  }
+
+  if (s->queue_len == s->queue_cap) {
+    size_t cap = s->queue_cap ? s->queue_cap * 2 : 4;
+    struct anim **queue =
+        (struct anim **)realloc(s->queue, cap * sizeof(*queue));
+    if (!queue)
+      return -1;
+    s->queue = queue;
+    s->queue_cap = cap;
+  }
+
+  a->refs += 1;
+  s->queue[s->queue_len] = a;
+  s->queue_len += 1;
+  return 0;
+}
+
+void player_stop(struct stream *s) {
+  if (s->in_heap)
+    s->stop_pending = 1;
+}
+
+void player_set_brightness(struct stream *s, float br) {
+  // frames are decoded at full brightness. gamma is a power curve, so
+  // scaling brightness by br before it equals scaling by br^gamma after.
+  // white has no gamma of its own, green's stands in.
+  const float gammas[4] = {R_GAMMA, G_GAMMA, B_GAMMA, G_GAMMA};
+  for (int c = 0; c < 4; c++) {
+    float k = powf(br, gammas[c]);
+    for (int v = 0; v < 256; v++)
+      s->scale_lut[c][v] = (uint8_t)(v * k + 0.5f);
+    s->scale_k[c] = (uint32_t)(k * 65536.0f);
+  }
+
+  s->brightness = br;
+  s->scaled = br < 1.0f;
+}
+
+void player_set_power(struct stream *s, const struct power_opts *p) {
+  s->power = *p;
+}
+
+void player_get_stats(const struct stream *s, struct player_stats *st) {
+  st->anim = s->anim;
+  st->frame = s->cur_frame;
+  st->loops = s->loops_done;
+  st->queued = s->queue_len;
+  st->frames_sent = s->frames_sent;
+  st->late_frames = s->late_frames;
+  st->limited_frames = s->limited_frames;
+  st->brightness = s->brightness;
+}
+
+int engine_run(struct engine *e) {
+  uint64_t start = mono_ns();
+  for (size_t i = 0; i < e->count;) {
+    struct stream *s = e->heap[i];
+    s->deadline = start;
+    s->in_heap = 1;
+
+    // a synced stream whose loops all passed before it was ready is done
+    if (s->synced && !stream_align(s, start)) {
+      e->heap[i] = e->heap[--e->count];
+      stream_free(s);
+      continue;
+    }
+    i++;
+  }
+
+  // synced deadlines differ, so restore the heap order
+  for (size_t i = e->count / 2; i-- > 0;)
+    heap_down(e, i);
+
+  arm_timer(e);
+
+  struct epoll_event events[MAX_EVENTS];
+  int running = 1;
+
+  // watched fds (e.g. a control socket) keep the loop alive when idle
+  while (running && (e->count > 0 || e->watches)) {
+    int n = epoll_wait(e->epfd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "epoll_wait failed: %s\n", strerror(errno));
+      return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+
+      if (fd == e->tfd) {
+        uint64_t expirations;
+        // nonblocking; EAGAIN just means the timer was re-armed meanwhile
+        if (read(e->tfd, &expirations, sizeof(expirations)) < 0 &&
+            errno != EAGAIN)
+          return -1;
+
+        if (engine_fire(e) != 0)
+          return -1;
+      } else if (fd == e->sfd) {
+        running = 0;
+      } else {
+        for (struct watch *w = e->watches; w; w = w->next) {
+          if (w->fd == fd) {
+            w->cb(e, fd, w->ctx);
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  if (e->bursts > 0)
+    fprintf(stderr, "wall: %llu frames, push burst avg %.1f us, max %.1f us\n",
+            (unsigned long long)e->bursts,
+            e->burst_ns_total / 1e3 / (double)e->bursts,
+            e->burst_ns_max / 1e3);
+
+  return 0;
+}
+
+int engine_read_checkpoint(const char *path, struct play_opts *play) {
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return errno == ENOENT ? 0 : -1;
+
+  size_t frame;
+  int loops_done;
+  int n = fscanf(fp, "%zu %d", &frame, &loops_done);
+  fclose(fp);
+
+  if (n != 2 || loops_done < 0) {
+    fprintf(stderr, "invalid checkpoint: %s\n", path);
+    return -1;
+  }
+
+  play->start_frame = frame;
+  play->start_ms = 0;
+  play->loops_done = loops_done;
+  return 1;
+}
+
+int engine_write_checkpoint(const struct engine *e, const char *path) {
+  // nothing left to resume: the next run starts from the top
+  if (e->count == 0) {
+    if (unlink(path) != 0 && errno != ENOENT)
+      return -1;
+    return 0;
+  }
+
+  // heap order changes with every deadline, the order streams were added
+  // in doesn't
+  const struct stream *s = NULL;
+  for (size_t i = 0; i < e->count; i++)
+    if (!e->heap[i]->player && (!s || e->heap[i]->id < s->id))
+      s = e->heap[i];
+  if (!s)
+    return 0;
+
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    fprintf(stderr, "failed to write checkpoint %s: %s\n", path,
+            strerror(errno));
+    return -1;
+  }
+
+  // frame numbers are in the source animation, wherever frames[0] starts
+  fprintf(fp, "%zu %d\n", s->anim->opts.first_frame + s->cur_frame,
+          s->loops_done);
+  return fclose(fp) == 0 ? 0 : -1;
+}
+
+void engine_destroy(struct engine *e) {
+  if (!e)
+    return;
+
+  // players are freed through the player list, in the heap or not
+  for (size_t i = 0; i < e->count; i++)
+    if (!e->heap[i]->player)
+      stream_free(e->heap[i]);
+  free(e->heap);
+
+  for (size_t i = 0; i < e->player_count; i++)
+    stream_free(e->players[i]);
+  free(e->players);
+
+  while (e->watches)
+    engine_unwatch(e, e->watches->fd);
+
+  if (e->tfd >= 0)
+    close(e->tfd);
+  if (e->sfd >= 0)
+    close(e->sfd);
+  if (e->epfd >= 0)
+    close(e->epfd);
+  free(e);
+}
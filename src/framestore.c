@@ -0,0 +1,235 @@
+#include "../include/framestore.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// worst case, all literals: one control byte per 128 pixels
+static size_t max_encoded(size_t frame_size, size_t unit) {
+  return frame_size + (frame_size / unit + 127) / 128;
+}
+
+static size_t rle_encode(const uint8_t *src, size_t frame_size, size_t unit,
+                         uint8_t *out) {
+  size_t n = frame_size / unit;
+  size_t o = 0;
+  size_t i = 0;
+
+  while (i < n) {
+    size_t run = 1;
+    while (i + run < n && run < 128 &&
+           memcmp(src + (i + run) * unit, src + i * unit, unit) == 0)
+      run += 1;
+
+    if (run > 1) {
+      out[o++] = (uint8_t)(0x80 | (run - 1));
+      memcpy(out + o, src + i * unit, unit);
+      o += unit;
+      i += run;
+      continue;
+    }
+
+    // literals up to where the next run starts
+    size_t start = i;
+    while (i < n && i - start < 128 &&
+           (i + 1 >= n ||
+            memcmp(src + i * unit, src + (i + 1) * unit, unit) != 0))
+      i += 1;
+
+    size_t len = i - start;
+    out[o++] = (uint8_t)(len - 1);
+    memcpy(out + o, src + start * unit, len * unit);
+    o += len * unit;
+  }
+
+  return o;
+}
+
+// decodes into out, or XORs into it for a delta
+static void rle_decode(const uint8_t *in, size_t frame_size, size_t unit,
+                       uint8_t *out, int delta) {
+  size_t o = 0;
+  while (o < frame_size) {
+    uint8_t c = *in++;
+
+    if (c & 0x80) {
+      size_t len = ((size_t)(c & 0x7f) + 1) * unit;
+      const uint8_t *px = in;
+      in += unit;
+
+      if (!delta) {
+        for (size_t i = 0; i < len; i += unit)
+          memcpy(out + o + i, px, unit);
+      } else {
+        // unchanged pixels are a zero run: nothing to do
+        int zero = 1;
+        for (size_t b = 0; b < unit; b++)
+          zero &= px[b] == 0;
+        for (size_t i = 0; !zero && i < len; i++)
+          out[o + i] ^= px[i % unit];
+      }
+      o += len;
+    } else {
+      size_t len = ((size_t)c + 1) * unit;
+      if (!delta) {
+        memcpy(out + o, in, len);
+      } else {
+        for (size_t i = 0; i < len; i++)
+          out[o + i] ^= in[i];
+      }
+      in += len;
+      o += len;
+    }
+  }
+}
+
+int frame_store_init(struct frame_store *fs, size_t frame_size, size_t unit,
+                     size_t key_interval) {
+  memset(fs, 0, sizeof(*fs));
+  fs->frame_size = frame_size;
+  fs->unit = unit;
+  fs->key_interval = key_interval ? key_interval : 1;
+
+  // a key and a delta encoding, and the diff the delta is made from
+  size_t max = max_encoded(frame_size, unit);
+  fs->work = (uint8_t *)malloc(2 * max + frame_size);
+  fs->prev = (uint8_t *)malloc(frame_size);
+  fs->offsets = (size_t *)malloc(sizeof(*fs->offsets));
+
+  // grown as frames are encoded, then trimmed
+  fs->data_cap = max * 4;
+  fs->data = (uint8_t *)malloc(fs->data_cap);
+
+  if (!fs->work || !fs->prev || !fs->offsets || !fs->data) {
+    frame_store_free(fs);
+    return -1;
+  }
+  fs->offsets[0] = 0;
+  return 0;
+}
+
+int frame_store_append(struct frame_store *fs, const uint8_t *frame) {
+  size_t frame_size = fs->frame_size;
+  size_t i = fs->frame_count;
+
+  if (i == fs->frame_cap) {
+    size_t cap = fs->frame_cap ? fs->frame_cap * 2 : 64;
+    size_t *offsets =
+        (size_t *)realloc(fs->offsets, (cap + 1) * sizeof(*offsets));
+    if (!offsets)
+      return -1;
+    fs->offsets = offsets;
+    uint8_t *is_key = (uint8_t *)realloc(fs->is_key, cap);
+    if (!is_key)
+      return -1;
+    fs->is_key = is_key;
+    fs->frame_cap = cap;
+  }
+
+  size_t max = max_encoded(frame_size, fs->unit);
+  uint8_t *key = fs->work;
+  uint8_t *delta = fs->work + max;
+  uint8_t *diff = fs->work + 2 * max;
+
+  size_t key_len = rle_encode(frame, frame_size, fs->unit, key);
+  const uint8_t *enc = key;
+  size_t len = key_len;
+  fs->is_key[i] = 1;
+
+  if (i % fs->key_interval != 0) {
+    for (size_t b = 0; b < frame_size; b++)
+      diff[b] = frame[b] ^ fs->prev[b];
+    size_t delta_len = rle_encode(diff, frame_size, fs->unit, delta);
+    if (delta_len < key_len) {
+      enc = delta;
+      len = delta_len;
+      fs->is_key[i] = 0;
+    }
+  }
+
+  size_t used = fs->offsets[i];
+  if (used + len > fs->data_cap) {
+    size_t cap = fs->data_cap;
+    while (used + len > cap)
+      cap *= 2;
+    uint8_t *data = (uint8_t *)realloc(fs->data, cap);
+    if (!data)
+      return -1;
+    fs->data = data;
+    fs->data_cap = cap;
+  }
+
+  memcpy(fs->data + used, enc, len);
+  fs->offsets[i + 1] = used + len;
+  memcpy(fs->prev, frame, frame_size);
+  fs->frame_count += 1;
+  return 0;
+}
+
+void frame_store_finish(struct frame_store *fs) {
+  free(fs->prev);
+  free(fs->work);
+  fs->prev = NULL;
+  fs->work = NULL;
+
+  size_t used = fs->offsets[fs->frame_count];
+  uint8_t *data = (uint8_t *)realloc(fs->data, used ? used : 1);
+  if (data) {
+    fs->data = data;
+    fs->data_cap = used;
+  }
+}
+
+void frame_store_free(struct frame_store *fs) {
+  free(fs->data);
+  free(fs->offsets);
+  free(fs->is_key);
+  free(fs->prev);
+  free(fs->work);
+  memset(fs, 0, sizeof(*fs));
+}
+
+size_t frame_store_bytes(const struct frame_store *fs) {
+  return fs->offsets ? fs->offsets[fs->frame_count] : 0;
+}
+
+static void decode_frame(const struct frame_store *fs, size_t i,
+                         uint8_t *out) {
+  rle_decode(fs->data + fs->offsets[i], fs->frame_size, fs->unit, out,
+             !fs->is_key[i]);
+}
+
+const uint8_t *frame_cursor_get(struct frame_cursor *c,
+                                const struct frame_store *fs, size_t i) {
+  if (c->cap < fs->frame_size) {
+    uint8_t *buf = (uint8_t *)realloc(c->buf, fs->frame_size);
+    if (!buf)
+      return NULL;
+    c->buf = buf;
+    c->cap = fs->frame_size;
+    c->fs = NULL;
+  }
+
+  int have = c->fs == fs;
+  if (have && c->index == i)
+    return c->buf;
+
+  if (have && i == c->index + 1) {
+    decode_frame(fs, i, c->buf);
+  } else {
+    // back to the last key, then forward
+    size_t k = i;
+    while (!fs->is_key[k])
+      k -= 1;
+    for (; k <= i; k++)
+      decode_frame(fs, k, c->buf);
+  }
+
+  c->fs = fs;
+  c->index = i;
+  return c->buf;
+}
+
+void frame_cursor_free(struct frame_cursor *c) {
+  free(c->buf);
+  memset(c, 0, sizeof(*c));
+}
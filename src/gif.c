@@ -1,9 +1,13 @@
 #include "../include/gif.h"
 
 #include <math.h>
+#include <pthread.h>
 #include <stdio.h>
 
 #include "../include/config.h"
+#include "../include/pixel.h"
+#include "../include/pool.h"
+#include "../include/seekcache.h"
 #include "../lib/gifdec/gifdec.h"
 
 // precalculate gamma values
@@ -11,6 +15,18 @@ uint8_t gamma_lut_r[256];
 uint8_t gamma_lut_g[256];
 uint8_t gamma_lut_b[256];
 
+// sampling workers, 0 = one per CPU
+static int g_sample_threads = 0;
+
+// the workers, shared by every extraction so concurrent loads (daemon
+// mode) don't each start their own. created on first use and kept for
+// the life of the process.
+static struct pool *g_pool;
+static pthread_mutex_t g_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// decode only the sampled pixels (see extract_set_low_memory())
+static int g_low_memory = 0;
+
 void init_gamma(void) {
   for (int i = 0; i < 256; i++) {
     float x = i / 255.0f;
@@ -20,41 +36,336 @@ void init_gamma(void) {
   }
 }
 
-size_t extract_gif_frames(const char *fname, uint8_t ***frames,
-                          size_t **delays_in_ms, float br) {
+size_t frame_at_ms(const size_t *delays_in_ms, size_t frame_count,
+                   size_t ms) {
+  size_t total = 0;
+  for (size_t i = 0; i < frame_count; i++)
+    total += delays_in_ms[i];
+  if (total == 0)
+    return 0;
+
+  // times past the end wrap around, like a looping animation
+  ms %= total;
+  size_t i = 0;
+  while (ms >= delays_in_ms[i]) {
+    ms -= delays_in_ms[i];
+    i += 1;
+  }
+  return i;
+}
+
+static size_t gce_delay_ms(const gd_GCE *gce) {
+  int delay_in_ms = gce->delay * 10;
+  return delay_in_ms <= 0 ? MIN_DELAY_IN_MS : (size_t)delay_in_ms;
+}
+
+// shared by every frame of one extraction
+struct sampler {
+  const size_t *gather; // source pixel of each LED, in wire order, NULL
+                        // if the canvas is already just the LEDs
+  size_t led_count;
+  float br;
+  const struct power_opts *power;
+  enum pixel_format format;
+  uint16_t lut16[3][256]; // PIXEL_RGB16 only, see gamma16_tables()
+  uint8_t **frames;
+
+  // canvases the decoder renders into. a worker hands its slot back once
+  // the frame is sampled.
+  pthread_mutex_t lock;
+  pthread_cond_t freed;
+  struct sample_job **free_slots;
+  size_t free_count;
+
+  size_t limited;
+  uint32_t peak_ma;
+  int failed;
+};
+
+struct sample_job {
+  struct sampler *sm;
+  uint8_t *canvas;
+  uint8_t *planes; // led_count * 3, for formats other than rgb
+  size_t index;
+};
+
+// 16 bit gamma with color correction and brightness folded in. scaling
+// 8 bit values first would leave a dim frame only a few levels to use.
+static void gamma16_tables(float br, uint16_t lut[3][256]) {
+  const float gammas[3] = {R_GAMMA, G_GAMMA, B_GAMMA};
+  const float corrections[3] = {R_CORRECTION, G_CORRECTION, B_CORRECTION};
+
+  for (int c = 0; c < 3; c++) {
+    for (int v = 0; v < 256; v++) {
+      float x = v * corrections[c];
+      if (x > 255.0f)
+        x = 255.0f;
+      x = x / 255.0f * br;
+      lut[c][v] = (uint16_t)(powf(x, gammas[c]) * 65535.0f + 0.5f);
+    }
+  }
+}
+
+// samples one rendered canvas into a new LED buffer, in wire order.
+// other formats than rgb are sampled into planes first, which the kernels
+// in pixel.c pack; planes is NULL for rgb.
+static uint8_t *sample_frame(const struct sampler *sm, const uint8_t *canvas,
+                             uint8_t *planes, int *limited, uint32_t *ma) {
+  size_t led_count = sm->led_count;
+  float br = sm->br;
+
+  size_t len = led_count * pixel_size(sm->format);
+  uint8_t *data_buffer = (uint8_t *)malloc(len);
+  if (!data_buffer)
+    return NULL;
+
+  for (size_t i = 0; i < led_count; i += 1) {
+    size_t index = sm->gather ? sm->gather[i] : i;
+
+    uint8_t r = canvas[index * 3 + 0];
+    uint8_t g = canvas[index * 3 + 1];
+    uint8_t b = canvas[index * 3 + 2];
+
+    // the 16 bit tables do all of the below at once
+    if (sm->format == PIXEL_RGB16) {
+      planes[i] = r;
+      planes[led_count + i] = g;
+      planes[led_count * 2 + i] = b;
+      continue;
+    }
+
+    // color correction
+    r = clamp_u8((int)(r * R_CORRECTION));
+    g = clamp_u8((int)(g * G_CORRECTION));
+    b = clamp_u8((int)(b * B_CORRECTION));
+
+    // brightness
+    r = (uint8_t)(r * br);
+    g = (uint8_t)(g * br);
+    b = (uint8_t)(b * br);
+
+    // gamma correction
+    r = gamma_lut_r[clamp_u8(r)];
+    g = gamma_lut_g[clamp_u8(g)];
+    b = gamma_lut_b[clamp_u8(b)];
+
+    if (planes) {
+      planes[i] = r;
+      planes[led_count + i] = g;
+      planes[led_count * 2 + i] = b;
+      continue;
+    }
+
+    // update frame buffer
+    data_buffer[i * 3 + 0] = r;
+    data_buffer[i * 3 + 1] = g;
+    data_buffer[i * 3 + 2] = b;
+  }
+
+  if (sm->format == PIXEL_RGBW8)
+    pixel_pack_rgbw(planes, planes + led_count, planes + led_count * 2,
+                    led_count, data_buffer);
+  else if (sm->format == PIXEL_RGB16)
+    pixel_pack_rgb16(planes, planes + led_count, planes + led_count * 2,
+                     sm->lut16, led_count, data_buffer);
+
+  // over-budget frames are scaled once here, so sending costs nothing
+  if (sm->power->budget_ma) {
+    *ma = power_estimate_ma(data_buffer, len, led_count, sm->format,
+                            sm->power);
+    *limited = power_limit(data_buffer, len, led_count, sm->format,
+                           sm->power);
+  }
+
+  return data_buffer;
+}
+
+// pool job: every job writes its own frame slot, only the shared counters
+// and the free canvas list need the lock
+static void sample_job_run(void *arg) {
+  struct sample_job *job = (struct sample_job *)arg;
+  struct sampler *sm = job->sm;
+
+  int limited = 0;
+  uint32_t ma = 0;
+  uint8_t *data = sample_frame(sm, job->canvas, job->planes, &limited, &ma);
+
+  pthread_mutex_lock(&sm->lock);
+  sm->frames[job->index] = data;
+  if (!data)
+    sm->failed = 1;
+  sm->limited += (size_t)limited;
+  if (ma > sm->peak_ma)
+    sm->peak_ma = ma;
+  sm->free_slots[sm->free_count++] = job;
+  pthread_cond_signal(&sm->freed);
+  pthread_mutex_unlock(&sm->lock);
+}
+
+void extract_set_threads(int threads) { g_sample_threads = threads; }
+
+// the shared sampling pool, NULL if its threads can't be started
+static struct pool *shared_pool(int threads) {
+  pthread_mutex_lock(&g_pool_lock);
+  if (!g_pool)
+    g_pool = pool_create(threads);
+  struct pool *pool = g_pool;
+  pthread_mutex_unlock(&g_pool_lock);
+  return pool;
+}
+
+int extract_fits(int gif_width, int gif_height, int width, int height,
+                 char *why, size_t len) {
+  // gif aspect ratio, important for sampling. it has to match the LED
+  // grid's, which is square for a single matrix.
+  float ar = (float)gif_width / (float)gif_height;
+  float grid_ar = (float)width / (float)height;
+
+  if (fabsf(ar / grid_ar - 1.0f) > 0.02f) {
+    snprintf(why, len,
+             "the gif aspect ratio (%.3f) doesn't match the grid (%.3f)", ar,
+             grid_ar);
+    return 0;
+  }
+
+  if (gif_width < width || gif_height < height) {
+    snprintf(why, len, "the gif (%dx%d) is smaller than the grid (%dx%d)",
+             gif_width, gif_height, width, height);
+    return 0;
+  }
+
+  return 1;
+}
+
+void extract_estimate(int gif_width, int gif_height, size_t frame_count,
+                      size_t duration_ms, const struct extract_opts *opts,
+                      struct extract_estimate *est) {
+  size_t led_count =
+      opts->map ? opts->led_count : (size_t)opts->width * opts->height;
+  size_t pixels = (size_t)gif_width * gif_height;
+  size_t frame_size = led_count * pixel_size(opts->format);
+  size_t gather = led_count * sizeof(size_t);
+
+  // the decoder's own buffers, and one canvas as extraction sizes them
+  int sparse = g_low_memory;
+  size_t canvas = sparse ? led_count * 3 : pixels * 3;
+  size_t decoder = sparse ? pixels + canvas + gather : pixels * 4;
+
+  int threads = g_sample_threads > 0 ? g_sample_threads
+                                     : pool_default_threads();
+  if ((size_t)threads > frame_count)
+    threads = (int)frame_count;
+  size_t slots = threads > 1 && !sparse ? (size_t)threads * 2 : 1;
+
+  // seeking holds the index with two keyframes (frame 0's and the one it
+  // restores), sampling holds its slots and the frames, resampling both
+  // frame sets
+  size_t index = frame_count * (sizeof(off_t) + sizeof(gd_GCE));
+  size_t frames = frame_count * frame_size;
+  size_t slot = canvas + (opts->format != PIXEL_RGB8 ? led_count * 3 : 0);
+  size_t index_peak = decoder + gather + index + 2 * canvas;
+  size_t decode_peak = decoder + gather + slots * slot + frames;
+  size_t peak = index_peak > decode_peak ? index_peak : decode_peak;
+
+  if (opts->fps) {
+    // an upper bound: identical output frames are only stored once
+    size_t count = (duration_ms * opts->fps + 500) / 1000;
+    if (count == 0)
+      count = 1;
+    size_t resampled = count * frame_size;
+    if (frames + resampled > peak)
+      peak = frames + resampled;
+    frames = resampled;
+  }
+
+  est->frames = frames;
+  est->peak = peak;
+}
+
+void extract_set_low_memory(int on) { g_low_memory = on; }
+
+// positions the decoder to read frame n next, decoding on from the
+// nearest keyframe before it. the index only has frame 0's; a cache may
+// have a nearer one, and gets every keyframe passed on the way.
+static int seek_frame(gd_GIF *gif, gd_Index *index, size_t n,
+                      struct seek_cache *cache) {
+  size_t interval = (size_t)index->interval;
+  if (n == 0)
+    return 0;
+
+  size_t k;
+  uint8_t *canvas = cache ? seek_cache_find(cache, n, &k) : NULL;
+  if (canvas && !index->keyframes[k / interval])
+    index->keyframes[k / interval] = canvas;
+  else
+    free(canvas);
+
+  k = n - n % interval;
+  while (!index->keyframes[k / interval])
+    k -= interval;
+  if (gd_index_seek(gif, index, k) != 0)
+    return -1;
+
+  for (; k < n; k++) {
+    if (gd_get_frame(gif) != 1)
+      return -1;
+    if (cache)
+      seek_cache_put(cache, k, gif->canvas);
+  }
+  return 0;
+}
+
+// encodes the sampled frames that are next in order into fs and frees
+// them, up to the first one still being sampled
+static int pack_sampled(struct sampler *sm, struct frame_store *fs,
+                        size_t *packed, size_t frame_count) {
+  while (*packed < frame_count) {
+    pthread_mutex_lock(&sm->lock);
+    uint8_t *frame = sm->frames[*packed];
+    pthread_mutex_unlock(&sm->lock);
+    if (!frame)
+      return 0;
+
+    if (frame_store_append(fs, frame) != 0)
+      return -1;
+    free(frame);
+    sm->frames[*packed] = NULL;
+    *packed += 1;
+  }
+  return 0;
+}
+
+// extract_gif_frames(), and with pack, extract_gif_packed(): frames are
+// then left NULL as they are encoded
+static size_t extract(const char *fname, uint8_t ***frames,
+                      struct frame_store *pack, size_t **delays_in_ms,
+                      struct extract_opts *opts) {
   // returns frame count, sets array of delays and array of frames
+  *frames = NULL;
+  *delays_in_ms = NULL;
+
   gd_GIF *handler = gd_open_gif(fname);
   if (!handler) {
-    *frames = NULL;
-    *delays_in_ms = NULL;
     fprintf(stderr, "failed to open gif: %s\n", fname);
     return 0;
   }
 
-  // gif aspect ratio, important for sampling
-  float ar = (float)handler->width / (float)handler->height;
+  int width = opts->width;
+  int height = opts->height;
 
-  if (fabsf(ar - 1.0f) > 0.02f) {
-    *frames = NULL;
-    *delays_in_ms = NULL;
+  char why[128];
+  if (!extract_fits(handler->width, handler->height, width, height, why,
+                    sizeof(why))) {
     gd_close_gif(handler);
-    fprintf(stderr, "the gif is not square enough (%.3f)\n", ar);
+    fprintf(stderr, "%s\n", why);
     return 0;
   }
 
-  // extract frame count
-  size_t frame_count = 0;
-  while (gd_get_frame(handler) != 0) {
-    frame_count += 1;
-  }
-  gd_rewind(handler);
+  const uint32_t *map = opts->map;
+  size_t led_count = map ? opts->led_count : (size_t)width * height;
 
-  // allocate array for frames and delays
-  *frames = (uint8_t **)malloc(frame_count * sizeof(uint8_t *));
-  *delays_in_ms = (size_t *)malloc(frame_count * sizeof(size_t));
-  if (!*frames || !*delays_in_ms) {
-    free(*frames);
-    free(*delays_in_ms);
+  size_t *gather = (size_t *)malloc(led_count * sizeof(size_t));
+  if (!gather) {
     gd_close_gif(handler);
     return 0;
   }
@@ -62,72 +373,246 @@ size_t extract_gif_frames(const char *fname, uint8_t ***frames,
   // we basically partition the gif into cells of the following width
   // and height so that we can sample color from the middle of the cell
   // which isn't the worst way of doing this.
-  int cell_w = handler->width / MATRIX_WIDTH;
-  int cell_h = handler->height / MATRIX_HEIGHT;
+  int cell_w = handler->width / width;
+  int cell_h = handler->height / height;
 
-  size_t cur_frame_index = 0;
-
-  while (gd_get_frame(handler) != 0) {
+  // the source pixel of every LED, in wire order. resolving the wiring
+  // here means sampling writes packet order directly, with no remap pass.
+  for (size_t i = 0; i < led_count; i++) {
+    size_t led = map ? map[i] : i;
+    int px = (int)(led % width) * cell_w + cell_w / 2;
+    int py = (int)(led / width) * cell_h + cell_h / 2;
+    gather[i] = (size_t)py * handler->width + px;
+  }
 
-    int delay_in_ms = handler->gce.delay * 10;
+  // in low-memory mode the decoder only composites the sampled pixels, so
+  // its canvas, keyframes and the render buffer are led_count RGB triples
+  // instead of full images, already in wire order
+  int sparse = g_low_memory && gd_set_points(handler, gather, led_count) == 0;
 
-    uint8_t *frame_buffer =
-        (uint8_t *)malloc(handler->width * handler->height * BYTES_PER_LED);
+  // one walk over the file structure, decoding nothing, gives the frame
+  // count, every frame's delay and where to seek to
+  gd_Index *index = gd_index_build(handler, SEEK_KEYFRAME_INTERVAL);
+  if (!index) {
+    free(gather);
+    gd_close_gif(handler);
+    fprintf(stderr, "failed to index gif: %s\n", fname);
+    return 0;
+  }
 
-    uint8_t *data_buffer = (uint8_t *)malloc(NUM_LEDS * BYTES_PER_LED);
+  size_t total_frames = index->count;
+  size_t canvas_size = sparse ? led_count * 3
+                              : (size_t)handler->width * handler->height * 3;
 
-    if (!frame_buffer || !data_buffer) {
-      free(*frames);
-      free(*delays_in_ms);
+  if (opts->start_ms > 0) {
+    size_t *all_delays = (size_t *)malloc(total_frames * sizeof(size_t));
+    if (!all_delays) {
+      gd_index_free(index);
+      free(gather);
       gd_close_gif(handler);
-      fprintf(stderr, "framebuffer or databuffer allocation failed\n");
       return 0;
     }
+    for (size_t i = 0; i < total_frames; i++)
+      all_delays[i] = gce_delay_ms(&index->gces[i]);
+    opts->first_frame = frame_at_ms(all_delays, total_frames, opts->start_ms);
+    free(all_delays);
+  }
 
-    gd_render_frame(handler, frame_buffer);
-
-    for (int y = 0; y < MATRIX_HEIGHT; y += 1) {
-      for (int x = 0; x < MATRIX_WIDTH; x += 1) {
-        int px = x * cell_w + cell_w / 2;
-        int py = y * cell_h + cell_h / 2;
-        size_t index = py * handler->width + px;
-
-        uint8_t r = frame_buffer[index * 3 + 0];
-        uint8_t g = frame_buffer[index * 3 + 1];
-        uint8_t b = frame_buffer[index * 3 + 2];
-
-        // color correction
-        r = clamp_u8((int)(r * R_CORRECTION));
-        g = clamp_u8((int)(g * G_CORRECTION));
-        b = clamp_u8((int)(b * B_CORRECTION));
-
-        // brightness
-        r = (uint8_t)(r * br);
-        g = (uint8_t)(g * br);
-        b = (uint8_t)(b * br);
-
-        // gamma correction
-        r = gamma_lut_r[clamp_u8(r)];
-        g = gamma_lut_g[clamp_u8(g)];
-        b = gamma_lut_b[clamp_u8(b)];
-
-        // update frame buffer
-        size_t data_index = y * MATRIX_WIDTH + x;
-        data_buffer[data_index * 3 + 0] = r;
-        data_buffer[data_index * 3 + 1] = g;
-        data_buffer[data_index * 3 + 2] = b;
-      }
-    }
+  if (opts->first_frame >= total_frames) {
+    fprintf(stderr, "start frame %zu out of range (%zu frames)\n",
+            opts->first_frame, total_frames);
+    gd_index_free(index);
+    free(gather);
+    gd_close_gif(handler);
+    return 0;
+  }
+
+  // keyframes are stored as decoding passes them, and a stored one near
+  // the start saves decoding everything before it. a checkpoint's file
+  // keeps them for the next run; otherwise they are kept for this one, in
+  // memory or, short of it, in a temporary file. a cache that can't be
+  // opened only costs the decoding.
+  struct seek_cache *cache = NULL;
+  uint64_t points_hash =
+      seek_cache_points_hash(sparse ? gather : NULL, led_count);
+  if (opts->seek_cache)
+    cache = seek_cache_open(opts->seek_cache, fname, canvas_size,
+                            points_hash, total_frames,
+                            SEEK_KEYFRAME_INTERVAL);
+  else if (opts->first_frame > 0)
+    cache = seek_cache_shared(fname, canvas_size, points_hash, total_frames,
+                              SEEK_KEYFRAME_INTERVAL, g_low_memory);
+
+  if (seek_frame(handler, index, opts->first_frame, cache) != 0) {
+    fprintf(stderr, "failed to seek to frame %zu: %s\n", opts->first_frame,
+            fname);
+    seek_cache_close(cache);
+    gd_index_free(index);
+    free(gather);
+    gd_close_gif(handler);
+    return 0;
+  }
+
+  // nothing below seeks, so the index and its keyframes go right away
+  size_t frame_count = total_frames - opts->first_frame;
+  gd_index_free(index);
+
+  // allocate array for frames and delays. frames start NULL so a failed
+  // load can free whatever was sampled.
+  *frames = (uint8_t **)calloc(frame_count, sizeof(uint8_t *));
+  *delays_in_ms = (size_t *)malloc(frame_count * sizeof(size_t));
+  if (!*frames || !*delays_in_ms) {
+    free(*frames);
+    free(*delays_in_ms);
+    free(gather);
+    *frames = NULL;
+    *delays_in_ms = NULL;
+    seek_cache_close(cache);
+    gd_close_gif(handler);
+    return 0;
+  }
+
+  // decoding is sequential, every frame draws over the last one's canvas.
+  // sampling a rendered canvas is not, so it goes to the shared workers
+  // while the next frame decodes. a sparse canvas leaves the workers
+  // nothing worth splitting off, so it is sampled inline from one buffer.
+  int pool_threads = g_sample_threads > 0 ? g_sample_threads
+                                          : pool_default_threads();
+  int threads = pool_threads;
+  if ((size_t)threads > frame_count)
+    threads = (int)frame_count;
+  struct pool *pool =
+      threads > 1 && !sparse ? shared_pool(pool_threads) : NULL;
+
+  // two canvases per worker keep them busy while the decoder fills more
+  size_t slot_count = pool ? (size_t)threads * 2 : 1;
+
+  struct sampler sm = {.gather = sparse ? NULL : gather,
+                       .led_count = led_count,
+                       .br = opts->brightness,
+                       .power = &opts->power,
+                       .format = opts->format,
+                       .frames = *frames};
+  if (opts->format == PIXEL_RGB16)
+    gamma16_tables(opts->brightness, sm.lut16);
+  pthread_mutex_init(&sm.lock, NULL);
+  pthread_cond_init(&sm.freed, NULL);
+
+  struct sample_job *jobs =
+      (struct sample_job *)calloc(slot_count, sizeof(*jobs));
+  sm.free_slots =
+      (struct sample_job **)malloc(slot_count * sizeof(*sm.free_slots));
+  sm.failed = !jobs || !sm.free_slots;
+  for (size_t i = 0; !sm.failed && i < slot_count; i++) {
+    jobs[i].sm = &sm;
+    jobs[i].canvas = (uint8_t *)malloc(canvas_size);
+    if (opts->format != PIXEL_RGB8)
+      jobs[i].planes = (uint8_t *)malloc(led_count * 3);
+    sm.free_slots[sm.free_count++] = &jobs[i];
+    sm.failed =
+        !jobs[i].canvas || (opts->format != PIXEL_RGB8 && !jobs[i].planes);
+  }
+  size_t slots_made = sm.free_count;
 
-    (*frames)[cur_frame_index] = data_buffer;
-    (*delays_in_ms)[cur_frame_index] =
-        delay_in_ms <= 0 ? MIN_DELAY_IN_MS : delay_in_ms;
+  size_t cur_frame_index = 0;
+  size_t packed = 0;
+  int failed = sm.failed;
+
+  while (!failed && cur_frame_index < frame_count &&
+         gd_get_frame(handler) == 1) {
+
+    // wait for a worker to hand a canvas back
+    pthread_mutex_lock(&sm.lock);
+    while (sm.free_count == 0)
+      pthread_cond_wait(&sm.freed, &sm.lock);
+    struct sample_job *job = sm.free_slots[--sm.free_count];
+    failed = sm.failed;
+    pthread_mutex_unlock(&sm.lock);
+
+    // compressed, a frame is only held raw until it is encoded
+    if (pack && !failed &&
+        pack_sampled(&sm, pack, &packed, cur_frame_index) != 0)
+      failed = 1;
+
+    // the decoder's canvas is what this frame is drawn onto. only the
+    // next run starts further on; this one's keyframes stop at the start.
+    if (opts->seek_cache && cache)
+      seek_cache_put(cache, opts->first_frame + cur_frame_index,
+                     handler->canvas);
+
+    gd_render_frame(handler, job->canvas);
+    (*delays_in_ms)[cur_frame_index] = gce_delay_ms(&handler->gce);
+    job->index = cur_frame_index;
     cur_frame_index += 1;
-    free(frame_buffer);
+
+    if (!pool || pool_submit(pool, sample_job_run, job) != 0)
+      sample_job_run(job);
   }
 
+  // waits for the frames still being sampled: each hands its slot back
+  pthread_mutex_lock(&sm.lock);
+  while (sm.free_count < slots_made)
+    pthread_cond_wait(&sm.freed, &sm.lock);
+  if (failed)
+    sm.failed = 1;
+  pthread_mutex_unlock(&sm.lock);
+
+  if (pack && !sm.failed &&
+      (pack_sampled(&sm, pack, &packed, cur_frame_index) != 0 ||
+       packed < cur_frame_index))
+    sm.failed = 1;
+
+  for (size_t i = 0; jobs && i < slot_count; i++) {
+    free(jobs[i].canvas);
+    free(jobs[i].planes);
+  }
+  free(jobs);
+  free(sm.free_slots);
+  pthread_mutex_destroy(&sm.lock);
+  pthread_cond_destroy(&sm.freed);
+  free(gather);
+  seek_cache_close(cache);
   gd_close_gif(handler);
 
+  if (sm.failed) {
+    free_frames_and_delays(*frames, *delays_in_ms, frame_count);
+    *frames = NULL;
+    *delays_in_ms = NULL;
+    fprintf(stderr, "framebuffer or databuffer allocation failed\n");
+    return 0;
+  }
+
+  if (sm.limited)
+    fprintf(stderr, "%s: %zu of %zu frames limited to %u mA (peak %u mA)\n",
+            fname, sm.limited, cur_frame_index, opts->power.budget_ma,
+            sm.peak_ma);
+
+  return cur_frame_index;
+}
+
+size_t extract_gif_frames(const char *fname, uint8_t ***frames,
+                          size_t **delays_in_ms, struct extract_opts *opts) {
+  return extract(fname, frames, NULL, delays_in_ms, opts);
+}
+
+size_t extract_gif_packed(const char *fname, struct frame_store *fs,
+                          size_t **delays_in_ms, struct extract_opts *opts) {
+  size_t led_count =
+      opts->map ? opts->led_count : (size_t)opts->width * opts->height;
+  size_t unit = pixel_size(opts->format);
+  if (frame_store_init(fs, led_count * unit, unit,
+                       FRAME_STORE_KEY_INTERVAL) != 0)
+    return 0;
+
+  uint8_t **frames;
+  size_t frame_count = extract(fname, &frames, fs, delays_in_ms, opts);
+  free(frames);
+  if (frame_count == 0) {
+    frame_store_free(fs);
+    return 0;
+  }
+
+  frame_store_finish(fs);
   return frame_count;
 }
 
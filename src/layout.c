@@ -0,0 +1,177 @@
+#include "../include/layout.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct wiring {
+  int serpentine;
+  int columns;
+  int rotate; // 0, 90, 180, 270
+  int flip_h;
+  int flip_v;
+  int tile_cols;
+  int tile_rows;
+  const char *map_file;
+};
+
+static int parse_spec(char *spec, struct wiring *wr) {
+  for (char *save = NULL, *tok = strtok_r(spec, ",", &save); tok;
+       tok = strtok_r(NULL, ",", &save)) {
+    if (strcmp(tok, "serpentine") == 0 || strcmp(tok, "zigzag") == 0) {
+      wr->serpentine = 1;
+    } else if (strcmp(tok, "columns") == 0) {
+      wr->columns = 1;
+    } else if (strncmp(tok, "rotate=", 7) == 0) {
+      char *end;
+      errno = 0;
+      long deg = strtol(tok + 7, &end, 10);
+      if (errno || end == tok + 7 || *end != '\0' ||
+          (deg != 0 && deg != 90 && deg != 180 && deg != 270)) {
+        fprintf(stderr, "invalid rotation: %s (0, 90, 180, 270)\n", tok + 7);
+        return -1;
+      }
+      wr->rotate = (int)deg;
+    } else if (strcmp(tok, "flip=h") == 0) {
+      wr->flip_h = 1;
+    } else if (strcmp(tok, "flip=v") == 0) {
+      wr->flip_v = 1;
+    } else if (strncmp(tok, "tiles=", 6) == 0) {
+      int used = 0;
+      if (sscanf(tok + 6, "%dx%d%n", &wr->tile_cols, &wr->tile_rows,
+                 &used) != 2 ||
+          tok[6 + used] != '\0' || wr->tile_cols <= 0 ||
+          wr->tile_rows <= 0) {
+        fprintf(stderr, "invalid tile grid: %s (<cols>x<rows>)\n", tok + 6);
+        return -1;
+      }
+    } else if (strncmp(tok, "map=", 4) == 0) {
+      wr->map_file = tok + 4;
+    } else {
+      fprintf(stderr, "unknown layout option: %s\n", tok);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int load_map(const char *path, uint32_t *table, size_t count) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    fprintf(stderr, "failed to open map %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  size_t n = 0;
+  unsigned long v;
+  while (n < count && fscanf(fp, "%lu", &v) == 1) {
+    if (v >= count) {
+      fprintf(stderr, "%s: index %lu out of range (%zu LEDs)\n", path, v,
+              count);
+      fclose(fp);
+      return -1;
+    }
+    table[n++] = (uint32_t)v;
+  }
+
+  fclose(fp);
+
+  if (n != count) {
+    fprintf(stderr, "%s: expected %zu indices, got %zu\n", path, count, n);
+    return -1;
+  }
+
+  return 0;
+}
+
+uint32_t *layout_compile(const char *spec, int width, int height) {
+  size_t count = (size_t)width * height;
+  uint32_t *table = (uint32_t *)malloc(count * sizeof(*table));
+  char *copy = strdup(spec ? spec : "");
+  if (!table || !copy) {
+    free(table);
+    free(copy);
+    return NULL;
+  }
+
+  struct wiring wr = {.tile_cols = 1, .tile_rows = 1};
+  if (parse_spec(copy, &wr) != 0) {
+    free(table);
+    free(copy);
+    return NULL;
+  }
+
+  if (wr.map_file) {
+    int r = load_map(wr.map_file, table, count);
+    free(copy);
+    if (r != 0) {
+      free(table);
+      return NULL;
+    }
+    return table;
+  }
+  free(copy);
+
+  // the wire runs over the panel as mounted, which for a quarter turn
+  // has the grid's dimensions swapped
+  int quarter = wr.rotate == 90 || wr.rotate == 270;
+  int pw = quarter ? height : width;
+  int ph = quarter ? width : height;
+
+  if (pw % wr.tile_cols != 0 || ph % wr.tile_rows != 0) {
+    fprintf(stderr, "%dx%d tiles don't divide a %dx%d panel\n", wr.tile_cols,
+            wr.tile_rows, pw, ph);
+    free(table);
+    return NULL;
+  }
+
+  int tw = pw / wr.tile_cols;
+  int th = ph / wr.tile_rows;
+  size_t tile_size = (size_t)tw * th;
+
+  for (size_t i = 0; i < count; i++) {
+    size_t tile = i / tile_size;
+    int j = (int)(i % tile_size);
+
+    // position inside the tile along the wire
+    int line_len = wr.columns ? th : tw;
+    int line = j / line_len;
+    int along = j % line_len;
+    if (wr.serpentine && (line & 1))
+      along = line_len - 1 - along;
+
+    int px = (int)(tile % wr.tile_cols) * tw + (wr.columns ? line : along);
+    int py = (int)(tile / wr.tile_cols) * th + (wr.columns ? along : line);
+
+    // panel coordinates to grid coordinates
+    int x, y;
+    switch (wr.rotate) {
+    case 90:
+      x = ph - 1 - py;
+      y = px;
+      break;
+    case 180:
+      x = pw - 1 - px;
+      y = ph - 1 - py;
+      break;
+    case 270:
+      x = py;
+      y = pw - 1 - px;
+      break;
+    default:
+      x = px;
+      y = py;
+    }
+
+    if (wr.flip_h)
+      x = width - 1 - x;
+    if (wr.flip_v)
+      y = height - 1 - y;
+
+    table[i] = (uint32_t)y * width + x;
+  }
+
+  return table;
+}
@@ -0,0 +1,212 @@
+#include "../include/output.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "../include/show.h"
+
+// open sinks, so streams writing to the same place share one fd
+static struct sink *g_sinks = NULL;
+
+// show file every sent packet is copied into, if recording
+static struct show_writer *g_recorder = NULL;
+static uint16_t g_next_id = 0;
+
+static int open_udp(const char *hostport) {
+  // split "<host>:<port>" at the last colon
+  const char *colon = strrchr(hostport, ':');
+  if (!colon || colon == hostport || colon[1] == '\0') {
+    fprintf(stderr, "invalid udp output: %s (udp:<host>:<port>)\n",
+            hostport);
+    return -1;
+  }
+
+  char host[256];
+  size_t host_len = (size_t)(colon - hostport);
+  if (host_len >= sizeof(host)) {
+    fprintf(stderr, "udp host too long: %s\n", hostport);
+    return -1;
+  }
+  memcpy(host, hostport, host_len);
+  host[host_len] = '\0';
+
+  struct addrinfo hints = {0};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+
+  struct addrinfo *res = NULL;
+  int err = getaddrinfo(host, colon + 1, &hints, &res);
+  if (err != 0) {
+    fprintf(stderr, "failed to resolve %s: %s\n", hostport,
+            gai_strerror(err));
+    return -1;
+  }
+
+  int fd = -1;
+  for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0)
+      continue;
+    // connected, so plain write()/writev() sends one datagram
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+      break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(res);
+
+  if (fd < 0)
+    fprintf(stderr, "failed to connect udp output: %s\n", hostport);
+  return fd;
+}
+
+struct sink *sink_open(const char *spec) {
+  if (!spec || !*spec)
+    spec = "-";
+
+  for (struct sink *s = g_sinks; s; s = s->next) {
+    if (strcmp(s->spec, spec) == 0) {
+      s->refs += 1;
+      return s;
+    }
+  }
+
+  int fd;
+  if (strcmp(spec, "-") == 0) {
+    fd = STDOUT_FILENO;
+  } else if (strncmp(spec, "udp:", 4) == 0) {
+    fd = open_udp(spec + 4);
+  } else {
+    fd = open(spec, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      fprintf(stderr, "failed to open output %s: %s\n", spec,
+              strerror(errno));
+  }
+  if (fd < 0)
+    return NULL;
+
+  struct sink *s = (struct sink *)calloc(1, sizeof(*s));
+  char *name = strdup(spec);
+  if (!s || !name) {
+    free(s);
+    free(name);
+    if (fd != STDOUT_FILENO)
+      close(fd);
+    return NULL;
+  }
+
+  s->spec = name;
+  s->fd = fd;
+  s->id = g_next_id++;
+  s->refs = 1;
+  s->next = g_sinks;
+  g_sinks = s;
+
+  if (g_recorder)
+    show_declare_sink(g_recorder, s->id, s->spec);
+  return s;
+}
+
+void sink_record(struct show_writer *w) {
+  g_recorder = w;
+  for (struct sink *s = g_sinks; w && s; s = s->next)
+    show_declare_sink(w, s->id, s->spec);
+}
+
+// sequence numbers run 1-15; 0 would tell the receiver they are unused
+static uint8_t next_seq(struct sink *s) {
+  s->seq = (uint8_t)(s->seq % 15 + 1);
+  return s->seq;
+}
+
+// writes one packet, copying it into the recording if there is one
+static int sink_writev(struct sink *s, const struct iovec *iov, int iovcnt) {
+  if (g_recorder)
+    show_write_packet(g_recorder, s->id, iov, iovcnt);
+
+  ssize_t w;
+  do {
+    w = writev(s->fd, iov, iovcnt);
+  } while (w < 0 && errno == EINTR);
+
+  // a receiver that is not up yet is not fatal for udp
+  if (w < 0 && errno != ECONNREFUSED) {
+    fprintf(stderr, "write to %s failed: %s\n", s->spec, strerror(errno));
+    return -1;
+  }
+
+  return 0;
+}
+
+int sink_write(struct sink *s, const uint8_t *packet, size_t len) {
+  struct iovec iov = {.iov_base = (void *)packet, .iov_len = len};
+  return sink_writev(s, &iov, 1);
+}
+
+void sink_close(struct sink *s) {
+  if (!s || --s->refs > 0)
+    return;
+
+  for (struct sink **p = &g_sinks; *p; p = &(*p)->next) {
+    if (*p == s) {
+      *p = s->next;
+      break;
+    }
+  }
+
+  if (s->fd != STDOUT_FILENO)
+    close(s->fd);
+  free(s->spec);
+  free(s);
+}
+
+int sink_send_frame(struct sink *s, const struct ddp_header *header,
+                    const uint8_t *data, size_t len, int push) {
+  struct ddp_header frag = *header;
+  uint8_t wire[DDP_HEADER_SIZE];
+
+  size_t done = 0;
+  do {
+    size_t n = len - done;
+    if (n > DDP_MAX_DATA)
+      n = DDP_MAX_DATA;
+
+    int last = done + n == len;
+    frag.flags = DDP_FLAG_VER1 | (last && push ? DDP_FLAG_PUSH : 0);
+    frag.offset = header->offset + (uint32_t)done;
+    frag.length = (uint16_t)n;
+    frag.res1 = (uint8_t)((header->res1 & ~DDP_SEQ_MASK) | next_seq(s));
+    ddp_header_write(&frag, wire);
+
+    // header and payload go out in one write, without copying the frame
+    struct iovec iov[2] = {
+        {.iov_base = wire, .iov_len = DDP_HEADER_SIZE},
+        {.iov_base = (void *)(data + done), .iov_len = n},
+    };
+    if (sink_writev(s, iov, 2) != 0)
+      return -1;
+
+    done += n;
+  } while (done < len);
+
+  return 0;
+}
+
+int sink_send_push(struct sink *s, const struct ddp_header *header) {
+  struct ddp_header push = *header;
+  uint8_t wire[DDP_HEADER_SIZE];
+
+  push.flags = DDP_FLAG_VER1 | DDP_FLAG_PUSH;
+  push.length = 0;
+  push.res1 = (uint8_t)((header->res1 & ~DDP_SEQ_MASK) | next_seq(s));
+  ddp_header_write(&push, wire);
+
+  return sink_write(s, wire, DDP_HEADER_SIZE);
+}
@@ -0,0 +1,180 @@
+#include "../include/pixel.h"
+
+#include <string.h>
+
+#include "../include/ddp.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+static const char *const names[] = {
+    [PIXEL_RGB8] = "rgb",
+    [PIXEL_RGBW8] = "rgbw",
+    [PIXEL_RGB16] = "rgb16",
+};
+
+size_t pixel_size(enum pixel_format f) {
+  return pixel_channels(f) * pixel_depth(f);
+}
+
+size_t pixel_channels(enum pixel_format f) {
+  return f == PIXEL_RGBW8 ? 4 : 3;
+}
+
+uint8_t pixel_ddp_type(enum pixel_format f) {
+  switch (f) {
+  case PIXEL_RGBW8:
+    return DDP_TYPE_RGBW8;
+  case PIXEL_RGB16:
+    return DDP_TYPE_RGB16;
+  default:
+    return DDP_TYPE_RGB8;
+  }
+}
+
+int pixel_format_parse(const char *name, enum pixel_format *f) {
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strcmp(name, names[i]) == 0) {
+      *f = (enum pixel_format)i;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+const char *pixel_format_name(enum pixel_format f) { return names[f]; }
+
+void pixel_pack_rgbw(const uint8_t *r, const uint8_t *g, const uint8_t *b,
+                     size_t n, uint8_t *out) {
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  // 16 LEDs at a time: take out the minimum, then interleave bytes into
+  // r g / b w pairs and the pairs into whole pixels
+  for (; i + 16 <= n; i += 16) {
+    __m128i vr = _mm_loadu_si128((const __m128i *)(r + i));
+    __m128i vg = _mm_loadu_si128((const __m128i *)(g + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+    __m128i vw = _mm_min_epu8(_mm_min_epu8(vr, vg), vb);
+    vr = _mm_sub_epi8(vr, vw);
+    vg = _mm_sub_epi8(vg, vw);
+    vb = _mm_sub_epi8(vb, vw);
+
+    __m128i rg_lo = _mm_unpacklo_epi8(vr, vg);
+    __m128i rg_hi = _mm_unpackhi_epi8(vr, vg);
+    __m128i bw_lo = _mm_unpacklo_epi8(vb, vw);
+    __m128i bw_hi = _mm_unpackhi_epi8(vb, vw);
+
+    __m128i *o = (__m128i *)(out + i * 4);
+    _mm_storeu_si128(o + 0, _mm_unpacklo_epi16(rg_lo, bw_lo));
+    _mm_storeu_si128(o + 1, _mm_unpackhi_epi16(rg_lo, bw_lo));
+    _mm_storeu_si128(o + 2, _mm_unpacklo_epi16(rg_hi, bw_hi));
+    _mm_storeu_si128(o + 3, _mm_unpackhi_epi16(rg_hi, bw_hi));
+  }
+#elif defined(__ARM_NEON)
+  // vst4 interleaves four planes in one store
+  for (; i + 16 <= n; i += 16) {
+    uint8x16x4_t v;
+    uint8x16_t vr = vld1q_u8(r + i);
+    uint8x16_t vg = vld1q_u8(g + i);
+    uint8x16_t vb = vld1q_u8(b + i);
+    v.val[3] = vminq_u8(vminq_u8(vr, vg), vb);
+    v.val[0] = vsubq_u8(vr, v.val[3]);
+    v.val[1] = vsubq_u8(vg, v.val[3]);
+    v.val[2] = vsubq_u8(vb, v.val[3]);
+    vst4q_u8(out + i * 4, v);
+  }
+#endif
+
+  for (; i < n; i++) {
+    uint8_t w = r[i] < g[i] ? r[i] : g[i];
+    if (b[i] < w)
+      w = b[i];
+    out[i * 4 + 0] = (uint8_t)(r[i] - w);
+    out[i * 4 + 1] = (uint8_t)(g[i] - w);
+    out[i * 4 + 2] = (uint8_t)(b[i] - w);
+    out[i * 4 + 3] = w;
+  }
+}
+
+void pixel_pack_rgb16(const uint8_t *r, const uint8_t *g, const uint8_t *b,
+                      const uint16_t lut[3][256], size_t n, uint8_t *out) {
+  // table lookups don't vectorize without a gather, so this stays scalar;
+  // it runs once per frame at load time
+  for (size_t i = 0; i < n; i++) {
+    uint16_t c[3] = {lut[0][r[i]], lut[1][g[i]], lut[2][b[i]]};
+    for (int k = 0; k < 3; k++) {
+      out[i * 6 + k * 2 + 0] = (uint8_t)(c[k] >> 8);
+      out[i * 6 + k * 2 + 1] = (uint8_t)c[k];
+    }
+  }
+}
+
+void pixel_dither_thresholds(size_t led_count, uint8_t *thr) {
+  // 0..7 in bit-reversed order, scaled to the middle of 8 steps
+  static const uint8_t order[DITHER_PHASES] = {0, 4, 2, 6, 1, 5, 3, 7};
+
+  for (size_t phase = 0; phase < DITHER_PHASES; phase++) {
+    uint8_t *row = thr + phase * led_count * 3;
+    for (size_t i = 0; i < led_count; i++) {
+      uint8_t t = (uint8_t)(order[(phase + i) % DITHER_PHASES] * 32 + 16);
+      row[i * 3 + 0] = row[i * 3 + 1] = row[i * 3 + 2] = t;
+    }
+  }
+}
+
+void pixel_dither(const uint8_t *in, const uint8_t *thr, size_t n,
+                  uint8_t *out) {
+  size_t i = 0;
+
+  // v - (v >> 8) maps 0..65535 onto 0..65280, i.e. 8.8 fixed point of
+  // the 8 bit value, so exact 8 bit levels (v = 257 * x) don't dither
+#if defined(__SSE2__)
+  __m128i mask = _mm_set1_epi16(0x00ff);
+  __m128i bias = _mm_set1_epi8((char)0x80);
+  __m128i one = _mm_set1_epi8(1);
+  for (; i + 16 <= n; i += 16) {
+    __m128i v0 = _mm_loadu_si128((const __m128i *)(in + i * 2));
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(in + i * 2 + 16));
+    v0 = _mm_or_si128(_mm_slli_epi16(v0, 8), _mm_srli_epi16(v0, 8));
+    v1 = _mm_or_si128(_mm_slli_epi16(v1, 8), _mm_srli_epi16(v1, 8));
+    v0 = _mm_sub_epi16(v0, _mm_srli_epi16(v0, 8));
+    v1 = _mm_sub_epi16(v1, _mm_srli_epi16(v1, 8));
+
+    __m128i hi = _mm_packus_epi16(_mm_srli_epi16(v0, 8),
+                                  _mm_srli_epi16(v1, 8));
+    __m128i lo = _mm_packus_epi16(_mm_and_si128(v0, mask),
+                                  _mm_and_si128(v1, mask));
+
+    // unsigned lo > thr, as a signed compare of both shifted by 0x80
+    __m128i t = _mm_loadu_si128((const __m128i *)(thr + i));
+    __m128i up = _mm_cmpgt_epi8(_mm_xor_si128(lo, bias),
+                                _mm_xor_si128(t, bias));
+    hi = _mm_adds_epu8(hi, _mm_and_si128(up, one));
+    _mm_storeu_si128((__m128i *)(out + i), hi);
+  }
+#elif defined(__ARM_NEON)
+  for (; i + 16 <= n; i += 16) {
+    uint16x8_t v0 = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(in + i * 2)));
+    uint16x8_t v1 =
+        vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(in + i * 2 + 16)));
+    v0 = vsubq_u16(v0, vshrq_n_u16(v0, 8));
+    v1 = vsubq_u16(v1, vshrq_n_u16(v1, 8));
+
+    uint8x16_t hi = vcombine_u8(vshrn_n_u16(v0, 8), vshrn_n_u16(v1, 8));
+    uint8x16_t lo = vcombine_u8(vmovn_u16(v0), vmovn_u16(v1));
+    uint8x16_t up = vandq_u8(vcgtq_u8(lo, vld1q_u8(thr + i)), vdupq_n_u8(1));
+    vst1q_u8(out + i, vqaddq_u8(hi, up));
+  }
+#endif
+
+  for (; i < n; i++) {
+    unsigned v = (unsigned)in[i * 2] << 8 | in[i * 2 + 1];
+    v -= v >> 8;
+    unsigned o = (v >> 8) + ((v & 0xff) > thr[i]);
+    out[i] = (uint8_t)(o > 255 ? 255 : o);
+  }
+}
@@ -0,0 +1,115 @@
+#include "../include/pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct job {
+  pool_fn fn;
+  void *arg;
+  struct job *next;
+};
+
+struct pool {
+  pthread_t *threads;
+  int thread_count;
+
+  pthread_mutex_t lock;
+  pthread_cond_t work; // a job was queued, or the pool is shutting down
+
+  struct job *head, *tail;
+  int stop;
+};
+
+int pool_default_threads(void) {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (int)n : 1;
+}
+
+static void *worker(void *arg) {
+  struct pool *p = (struct pool *)arg;
+
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while (!p->head && !p->stop)
+      pthread_cond_wait(&p->work, &p->lock);
+    if (!p->head)
+      break;
+
+    struct job *j = p->head;
+    p->head = j->next;
+    if (!p->head)
+      p->tail = NULL;
+
+    pthread_mutex_unlock(&p->lock);
+    j->fn(j->arg);
+    free(j);
+    pthread_mutex_lock(&p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+struct pool *pool_create(int threads) {
+  struct pool *p = (struct pool *)calloc(1, sizeof(*p));
+  if (!p)
+    return NULL;
+
+  p->threads = (pthread_t *)calloc((size_t)threads, sizeof(*p->threads));
+  if (!p->threads) {
+    free(p);
+    return NULL;
+  }
+
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->work, NULL);
+
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&p->threads[i], NULL, worker, p) != 0)
+      break;
+    p->thread_count += 1;
+  }
+
+  if (p->thread_count == 0) {
+    pool_destroy(p);
+    return NULL;
+  }
+  return p;
+}
+
+int pool_submit(struct pool *p, pool_fn fn, void *arg) {
+  struct job *j = (struct job *)malloc(sizeof(*j));
+  if (!j)
+    return -1;
+  j->fn = fn;
+  j->arg = arg;
+  j->next = NULL;
+
+  pthread_mutex_lock(&p->lock);
+  if (p->tail)
+    p->tail->next = j;
+  else
+    p->head = j;
+  p->tail = j;
+  pthread_cond_signal(&p->work);
+  pthread_mutex_unlock(&p->lock);
+  return 0;
+}
+
+void pool_destroy(struct pool *p) {
+  if (!p)
+    return;
+
+  pthread_mutex_lock(&p->lock);
+  p->stop = 1;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->lock);
+
+  for (int i = 0; i < p->thread_count; i++)
+    pthread_join(p->threads[i], NULL);
+
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->work);
+  free(p->threads);
+  free(p);
+}
@@ -0,0 +1,168 @@
+#include "../include/power.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+uint64_t power_channel_sum(const uint8_t *data, size_t len) {
+  uint64_t sum = 0;
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  // psadbw against zero adds each 8 byte half into a 64 bit lane
+  __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+  }
+
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i *)lanes, acc);
+  sum = lanes[0] + lanes[1];
+#elif defined(__ARM_NEON)
+  // pairwise widening adds, 16 bytes into two 64 bit lanes
+  uint64x2_t acc = vdupq_n_u64(0);
+  for (; i + 16 <= len; i += 16) {
+    uint16x8_t s16 = vpaddlq_u8(vld1q_u8(data + i));
+    acc = vpadalq_u32(acc, vpaddlq_u16(s16));
+  }
+  sum = vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#endif
+
+  for (; i < len; i++)
+    sum += data[i];
+
+  return sum;
+}
+
+uint64_t power_channel_sum16(const uint8_t *data, size_t len) {
+  uint64_t hi = 0, lo = 0;
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  // the same psadbw sums, once over the high bytes and once over the low
+  // ones, so no value has to be byte-swapped or widened. loaded as 16 bit
+  // lanes, the big-endian high byte is each lane's low one.
+  __m128i zero = _mm_setzero_si128();
+  __m128i mask = _mm_set1_epi16(0x00ff);
+  __m128i acc_hi = zero;
+  __m128i acc_lo = zero;
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+    acc_hi = _mm_add_epi64(acc_hi, _mm_sad_epu8(_mm_and_si128(v, mask), zero));
+    acc_lo = _mm_add_epi64(acc_lo, _mm_sad_epu8(_mm_srli_epi16(v, 8), zero));
+  }
+
+  uint64_t lanes[2];
+  _mm_storeu_si128((__m128i *)lanes, acc_hi);
+  hi = lanes[0] + lanes[1];
+  _mm_storeu_si128((__m128i *)lanes, acc_lo);
+  lo = lanes[0] + lanes[1];
+#elif defined(__ARM_NEON)
+  // swap to host order, then pairwise widening adds
+  uint64x2_t acc = vdupq_n_u64(0);
+  for (; i + 16 <= len; i += 16) {
+    uint16x8_t v = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(data + i)));
+    acc = vpadalq_u32(acc, vpaddlq_u16(v));
+  }
+  lo = vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#endif
+
+  for (; i + 1 < len; i += 2) {
+    hi += data[i];
+    lo += data[i + 1];
+  }
+
+  return (hi << 8) + lo;
+}
+
+// channel sum of a frame, and the value of a channel at full duty
+static uint64_t frame_sum(const uint8_t *data, size_t len,
+                          enum pixel_format f, uint64_t *full) {
+  if (pixel_depth(f) == 2) {
+    *full = 65535;
+    return power_channel_sum16(data, len);
+  }
+  *full = 255;
+  return power_channel_sum(data, len);
+}
+
+uint32_t power_estimate_ma(const uint8_t *data, size_t len, size_t led_count,
+                           enum pixel_format f, const struct power_opts *p) {
+  uint64_t full;
+  uint64_t sum = frame_sum(data, len, f, &full);
+  return (uint32_t)(led_count * p->idle_ma + sum * p->channel_ma / full);
+}
+
+void power_channel_sums(const uint8_t *data, size_t len, enum pixel_format f,
+                        uint64_t sums[4]) {
+  size_t channels = pixel_channels(f);
+  for (size_t c = 0; c < 4; c++)
+    sums[c] = 0;
+
+  if (pixel_depth(f) == 2) {
+    for (size_t i = 0; i + 1 < len; i += 2)
+      sums[(i / 2) % channels] += (uint32_t)data[i] << 8 | data[i + 1];
+    return;
+  }
+
+  for (size_t i = 0; i + channels <= len; i += channels)
+    for (size_t c = 0; c < channels; c++)
+      sums[c] += data[i + c];
+}
+
+uint64_t power_budget_sum(size_t led_count, enum pixel_format f,
+                          const struct power_opts *p) {
+  if (p->budget_ma == 0 || p->channel_ma == 0)
+    return UINT64_MAX;
+
+  // the channel sum the budget allows once the idle draw is paid for
+  uint64_t full = pixel_depth(f) == 2 ? 65535 : 255;
+  uint64_t idle = (uint64_t)led_count * p->idle_ma;
+  return p->budget_ma > idle ? (p->budget_ma - idle) * full / p->channel_ma
+                             : 0;
+}
+
+int power_limit(uint8_t *data, size_t len, size_t led_count,
+                enum pixel_format f, const struct power_opts *p) {
+  if (p->budget_ma == 0 || p->channel_ma == 0)
+    return 0;
+
+  uint64_t full;
+  return power_limit_sum(data, len, led_count, f,
+                         frame_sum(data, len, f, &full), p);
+}
+
+int power_limit_sum(uint8_t *data, size_t len, size_t led_count,
+                    enum pixel_format f, uint64_t sum,
+                    const struct power_opts *p) {
+  uint64_t allowed = power_budget_sum(led_count, f, p);
+  if (sum <= allowed)
+    return 0;
+
+  // 16.16 scale, rounded down so the result never goes over
+  uint32_t k = (uint32_t)((allowed << 16) / sum);
+
+  // 16 bit values have too many levels for a table
+  if (pixel_depth(f) == 2) {
+    for (size_t i = 0; i + 1 < len; i += 2) {
+      uint32_t v = (uint32_t)data[i] << 8 | data[i + 1];
+      v = (v * k) >> 16;
+      data[i] = (uint8_t)(v >> 8);
+      data[i + 1] = (uint8_t)v;
+    }
+    return 1;
+  }
+
+  uint8_t lut[256];
+  for (int v = 0; v < 256; v++)
+    lut[v] = (uint8_t)(((uint32_t)v * k) >> 16);
+
+  for (size_t i = 0; i < len; i++)
+    data[i] = lut[data[i]];
+
+  return 1;
+}
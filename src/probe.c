@@ -0,0 +1,91 @@
+#include "../include/probe.h"
+
+#include "../include/clock.h"
+#include "../include/config.h"
+#include "../include/pixel.h"
+#include "../lib/gifdec/gifdec.h"
+
+// a JSON string, escaped
+static void json_string(FILE *fp, const char *s) {
+  fputc('"', fp);
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\')
+      fprintf(fp, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(fp, "\\u%04x", c);
+    else
+      fputc(c, fp);
+  }
+  fputc('"', fp);
+}
+
+int probe_gif(const char *path, const struct extract_opts *opts, FILE *fp) {
+  gd_Scan scan;
+  uint64_t t0 = mono_ns();
+  int ok = gd_scan(path, &scan) == 0;
+  uint64_t scan_ns = mono_ns() - t0;
+
+  // the same delays playback uses: 0 means the minimum
+  size_t duration_ms =
+      (size_t)scan.delay * 10 + scan.zero_delay * MIN_DELAY_IN_MS;
+
+  size_t led_count =
+      opts->map ? opts->led_count : (size_t)opts->width * opts->height;
+  char why[128] = "";
+  int fits = ok && extract_fits(scan.width, scan.height, opts->width,
+                                opts->height, why, sizeof(why));
+
+  fprintf(fp, "{\n  \"path\": ");
+  json_string(fp, path);
+  fprintf(fp, ",\n  \"ok\": %s,\n", ok ? "true" : "false");
+  if (!ok) {
+    fprintf(fp, "  \"error\": ");
+    json_string(fp, scan.error);
+    fprintf(fp, ",\n");
+  }
+
+  fprintf(fp,
+          "  \"file_bytes\": %lld,\n"
+          "  \"width\": %u,\n"
+          "  \"height\": %u,\n"
+          "  \"frames\": %zu,\n"
+          "  \"duration_ms\": %zu,\n"
+          "  \"loop_count\": %u,\n"
+          "  \"interlaced_frames\": %zu,\n"
+          "  \"transparent_frames\": %zu,\n"
+          "  \"local_palette_frames\": %zu,\n"
+          "  \"partial_frames\": %zu,\n"
+          "  \"restore_previous_frames\": %zu,\n"
+          "  \"lzw_bytes\": %zu,\n",
+          (long long)scan.file_size, scan.width, scan.height, scan.frames,
+          duration_ms, scan.loop_count, scan.interlaced, scan.transparent,
+          scan.local_palette, scan.partial, scan.restore_previous,
+          scan.lzw_bytes);
+
+  fprintf(fp,
+          "  \"grid\": {\"width\": %d, \"height\": %d, \"leds\": %zu,"
+          " \"format\": \"%s\", \"fps\": %u},\n",
+          opts->width, opts->height, led_count,
+          pixel_format_name(opts->format), opts->fps);
+  fprintf(fp, "  \"fits_grid\": %s,\n", fits ? "true" : "false");
+  if (ok && !fits) {
+    fprintf(fp, "  \"grid_error\": ");
+    json_string(fp, why);
+    fprintf(fp, ",\n");
+  }
+
+  // nothing to size if the file can't be loaded
+  if (fits) {
+    struct extract_estimate est;
+    extract_estimate(scan.width, scan.height, scan.frames, duration_ms, opts,
+                     &est);
+    fprintf(fp,
+            "  \"memory\": {\"frames_bytes\": %zu, "
+            "\"peak_bytes\": %zu},\n",
+            est.frames, est.peak);
+  }
+
+  fprintf(fp, "  \"scan_us\": %.1f\n}\n", (double)scan_ns / 1000.0);
+  return fits ? 0 : -1;
+}
@@ -0,0 +1,257 @@
+#include "../include/resample.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// FNV-1a, to find frames already in the store
+static uint64_t frame_hash(const uint8_t *data, size_t len) {
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= data[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// w = 0..256 is the weight of b. rounding down keeps a blend of two
+// frames inside the power budget both of them fit.
+static void crossfade(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+                      unsigned w, size_t len) {
+  for (size_t i = 0; i < len; i++)
+    dst[i] = (uint8_t)((a[i] * (256 - w) + b[i] * w) >> 8);
+}
+
+// the same over big-endian 16 bit channels
+static void crossfade16(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+                        unsigned w, size_t len) {
+  for (size_t i = 0; i + 1 < len; i += 2) {
+    uint32_t va = (uint32_t)a[i] << 8 | a[i + 1];
+    uint32_t vb = (uint32_t)b[i] << 8 | b[i + 1];
+    uint32_t v = (va * (256 - w) + vb * w) >> 8;
+    dst[i] = (uint8_t)(v >> 8);
+    dst[i + 1] = (uint8_t)v;
+  }
+}
+
+static void blend(uint8_t *dst, const uint8_t *a, const uint8_t *b,
+                  unsigned w, size_t len, enum pixel_format format) {
+  if (pixel_depth(format) == 2)
+    crossfade16(dst, a, b, w, len);
+  else
+    crossfade(dst, a, b, w, len);
+}
+
+// walks the output frames in order, tracking which source frame each
+// falls in
+struct resample_clock {
+  const size_t *delays_in_ms;
+  size_t frame_count;
+  unsigned fps;
+  size_t src;    // source frame showing at t
+  size_t src_at; // when it started, in ms
+};
+
+// output frames the animation resamples to, 0 if it can't be
+static size_t output_count(const size_t *delays_in_ms, size_t frame_count,
+                           unsigned fps) {
+  size_t total_ms = 0;
+  for (size_t i = 0; i < frame_count; i++)
+    total_ms += delays_in_ms[i];
+  if (fps == 0 || frame_count == 0 || total_ms == 0)
+    return 0;
+
+  size_t count = (total_ms * fps + 500) / 1000;
+  return count ? count : 1;
+}
+
+// output frame k, the next one: c->src is the source frame it falls in,
+// *w how far into it (0..256), and *delay how long k shows
+static void clock_step(struct resample_clock *c, size_t k, unsigned *w,
+                       size_t *delay) {
+  const size_t *delays_in_ms = c->delays_in_ms;
+  unsigned fps = c->fps;
+
+  // output frames start on exact multiples of 1000/fps; the integer
+  // delays alternate so the rate does not drift
+  size_t t_num = k * 1000; // t = t_num / fps ms
+  *delay = ((k + 1) * 1000) / fps - t_num / fps;
+
+  while (c->src + 1 < c->frame_count &&
+         t_num >= (c->src_at + delays_in_ms[c->src]) * fps) {
+    c->src_at += delays_in_ms[c->src];
+    c->src += 1;
+  }
+
+  // how far into the source frame, 0..256. the last frame fades into
+  // the first, since animations loop.
+  size_t into = t_num - c->src_at * fps;
+  size_t span = delays_in_ms[c->src] * fps;
+  *w = (unsigned)((into * 256 + span / 2) / span);
+  if (*w > 256)
+    *w = 256;
+}
+
+int resample_frames(uint8_t *const *frames, const size_t *delays_in_ms,
+                    size_t frame_count, size_t frame_size,
+                    enum pixel_format format, unsigned fps,
+                    struct resampled *out) {
+  memset(out, 0, sizeof(*out));
+
+  size_t count = output_count(delays_in_ms, frame_count, fps);
+  if (count == 0)
+    return -1;
+
+  // open addressing, at most half full
+  size_t slots = 1;
+  while (slots < count * 2)
+    slots <<= 1;
+
+  // each output frame is blended into scratch and only copied to the
+  // store if it isn't there yet, so the store grows with the distinct
+  // frames rather than being sized for all of them up front
+  size_t *table = (size_t *)malloc(slots * sizeof(*table));
+  uint64_t *hashes = (uint64_t *)malloc(count * sizeof(*hashes));
+  size_t *offsets = (size_t *)malloc(count * sizeof(*offsets));
+  uint8_t *scratch = (uint8_t *)malloc(frame_size);
+  uint8_t *store = NULL;
+  size_t store_cap = 0; // frames
+  out->frames = (uint8_t **)malloc(count * sizeof(*out->frames));
+  out->delays_in_ms = (size_t *)malloc(count * sizeof(*out->delays_in_ms));
+  if (!table || !hashes || !offsets || !scratch || !out->frames ||
+      !out->delays_in_ms)
+    goto fail;
+  memset(table, 0xff, slots * sizeof(*table));
+
+  size_t unique = 0;
+  struct resample_clock c = {.delays_in_ms = delays_in_ms,
+                             .frame_count = frame_count,
+                             .fps = fps};
+  for (size_t k = 0; k < count; k++) {
+    unsigned w;
+    clock_step(&c, k, &w, &out->delays_in_ms[k]);
+
+    uint8_t *dst = scratch;
+    blend(dst, frames[c.src], frames[(c.src + 1) % frame_count], w,
+          frame_size, format);
+
+    uint64_t h = frame_hash(dst, frame_size);
+    size_t slot = (size_t)h & (slots - 1);
+    size_t found = SIZE_MAX;
+    while (table[slot] != SIZE_MAX) {
+      size_t u = table[slot];
+      if (hashes[u] == h &&
+          memcmp(store + u * frame_size, dst, frame_size) == 0) {
+        found = u;
+        break;
+      }
+      slot = (slot + 1) & (slots - 1);
+    }
+
+    if (found == SIZE_MAX) {
+      if (unique == store_cap) {
+        size_t cap = store_cap ? store_cap * 2 : 16;
+        if (cap > count)
+          cap = count;
+        uint8_t *grown = (uint8_t *)realloc(store, cap * frame_size);
+        if (!grown)
+          goto fail;
+        store = grown;
+        store_cap = cap;
+      }
+      memcpy(store + unique * frame_size, dst, frame_size);
+      found = unique++;
+      hashes[found] = h;
+      table[slot] = found;
+    }
+    offsets[k] = found * frame_size;
+  }
+
+  // give back what doubling overshot
+  uint8_t *shrunk = (uint8_t *)realloc(store, unique * frame_size);
+  if (shrunk)
+    store = shrunk;
+
+  for (size_t k = 0; k < count; k++)
+    out->frames[k] = store + offsets[k];
+
+  out->frame_count = count;
+  out->store = store;
+  out->unique_count = unique;
+
+  free(table);
+  free(hashes);
+  free(offsets);
+  free(scratch);
+  return 0;
+
+fail:
+  free(table);
+  free(hashes);
+  free(offsets);
+  free(scratch);
+  free(store);
+  resampled_free(out);
+  return -1;
+}
+
+int resample_packed(const struct frame_store *src, const size_t *delays_in_ms,
+                    enum pixel_format format, unsigned fps,
+                    struct frame_store *out, size_t **out_delays) {
+  size_t frame_count = src->frame_count;
+  size_t frame_size = src->frame_size;
+  *out_delays = NULL;
+
+  size_t count = output_count(delays_in_ms, frame_count, fps);
+  if (count == 0)
+    return -1;
+
+  // one cursor on each side of the blend, both walking forward
+  struct frame_cursor ca = {0};
+  struct frame_cursor cb = {0};
+  uint8_t *scratch = (uint8_t *)malloc(frame_size);
+  size_t *delays = (size_t *)malloc(count * sizeof(*delays));
+  if (!scratch || !delays ||
+      frame_store_init(out, frame_size, src->unit, src->key_interval) != 0) {
+    free(scratch);
+    free(delays);
+    return -1;
+  }
+
+  struct resample_clock c = {.delays_in_ms = delays_in_ms,
+                             .frame_count = frame_count,
+                             .fps = fps};
+  int ret = 0;
+  for (size_t k = 0; ret == 0 && k < count; k++) {
+    unsigned w;
+    clock_step(&c, k, &w, &delays[k]);
+
+    const uint8_t *a = frame_cursor_get(&ca, src, c.src);
+    const uint8_t *b = frame_cursor_get(&cb, src, (c.src + 1) % frame_count);
+    if (!a || !b) {
+      ret = -1;
+      break;
+    }
+    blend(scratch, a, b, w, frame_size, format);
+    ret = frame_store_append(out, scratch);
+  }
+
+  frame_cursor_free(&ca);
+  frame_cursor_free(&cb);
+  free(scratch);
+  if (ret != 0) {
+    frame_store_free(out);
+    free(delays);
+    return -1;
+  }
+
+  frame_store_finish(out);
+  *out_delays = delays;
+  return 0;
+}
+
+void resampled_free(struct resampled *r) {
+  free(r->frames);
+  free(r->delays_in_ms);
+  free(r->store);
+  memset(r, 0, sizeof(*r));
+}
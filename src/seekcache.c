@@ -0,0 +1,285 @@
+#include "../include/seekcache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SEEK_CACHE_MAGIC "DDPSEEK1"
+
+// host byte order; a cache is only read back on the machine that wrote it
+struct seek_cache_header {
+  char magic[8];
+  uint64_t gif_size; // the gif as it was, to notice a changed file
+  int64_t gif_mtime_ns;
+  uint64_t canvas_size;
+  uint64_t points_hash;
+  uint64_t frame_count;
+  uint64_t interval;
+};
+
+struct seek_cache {
+  int fd; // -1 when the keyframes are held in memory
+  const char *path;
+  size_t canvas_size;
+  size_t interval;
+  size_t frame_count;
+
+  off_t *at; // canvas of each keyframe in the file, 0 = not stored
+  off_t end; // where the next record goes
+  uint8_t **mem; // or the canvases themselves, without a file
+  int failed;
+
+  // shared caches live for the process, looked up by what they were
+  // opened for
+  int shared;
+  pthread_mutex_t lock;
+  struct seek_cache_header id;
+  struct seek_cache *next;
+};
+
+// every shared cache, see seek_cache_shared()
+static struct seek_cache *g_shared;
+static pthread_mutex_t g_shared_lock = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t seek_cache_points_hash(const size_t *points, size_t n) {
+  if (!points)
+    return 0;
+
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; i < n; i++) {
+    h ^= (uint64_t)points[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+// reads back which keyframes the file holds. a record cut short by an
+// interrupted run ends the file there.
+static void load_records(struct seek_cache *c, off_t size) {
+  off_t rec = (off_t)(sizeof(uint64_t) + c->canvas_size);
+  off_t off = (off_t)sizeof(struct seek_cache_header);
+
+  for (; off + rec <= size; off += rec) {
+    uint64_t k;
+    if (pread(c->fd, &k, sizeof(k), off) != (ssize_t)sizeof(k) ||
+        k >= c->frame_count || k % c->interval != 0)
+      break;
+    c->at[k / c->interval] = off + (off_t)sizeof(k);
+  }
+
+  c->end = off;
+}
+
+// an empty cache for gif, not yet backed by anything. NULL on error.
+static struct seek_cache *cache_new(const char *gif, size_t canvas_size,
+                                    uint64_t points_hash, size_t frame_count,
+                                    size_t interval) {
+  struct stat st;
+  if (stat(gif, &st) != 0)
+    return NULL;
+
+  struct seek_cache *c = (struct seek_cache *)calloc(1, sizeof(*c));
+  size_t nkeys = (frame_count + interval - 1) / interval;
+  if (!c || !(c->at = (off_t *)calloc(nkeys, sizeof(*c->at)))) {
+    free(c);
+    return NULL;
+  }
+  c->fd = -1;
+  c->canvas_size = canvas_size;
+  c->interval = interval;
+  c->frame_count = frame_count;
+  pthread_mutex_init(&c->lock, NULL);
+
+  struct seek_cache_header *h = &c->id;
+  memcpy(h->magic, SEEK_CACHE_MAGIC, sizeof(h->magic));
+  h->gif_size = (uint64_t)st.st_size;
+  h->gif_mtime_ns =
+      (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  h->canvas_size = canvas_size;
+  h->points_hash = points_hash;
+  h->frame_count = frame_count;
+  h->interval = interval;
+  return c;
+}
+
+struct seek_cache *seek_cache_open(const char *path, const char *gif,
+                                   size_t canvas_size, uint64_t points_hash,
+                                   size_t frame_count, size_t interval) {
+  struct seek_cache *c =
+      cache_new(gif, canvas_size, points_hash, frame_count, interval);
+  if (!c)
+    return NULL;
+  c->path = path;
+
+  c->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (c->fd < 0) {
+    fprintf(stderr, "failed to open seek cache %s: %s\n", path,
+            strerror(errno));
+    seek_cache_close(c);
+    return NULL;
+  }
+
+  struct seek_cache_header h = c->id;
+
+  struct seek_cache_header old;
+  struct stat cst;
+  if (fstat(c->fd, &cst) == 0 &&
+      pread(c->fd, &old, sizeof(old), 0) == (ssize_t)sizeof(old) &&
+      memcmp(&old, &h, sizeof(h)) == 0) {
+    load_records(c, cst.st_size);
+    if (c->end < cst.st_size && ftruncate(c->fd, c->end) != 0)
+      c->failed = 1;
+    return c;
+  }
+
+  // another gif, or another canvas: nothing in it applies
+  if (ftruncate(c->fd, 0) != 0 ||
+      pwrite(c->fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) {
+    fprintf(stderr, "failed to write seek cache %s: %s\n", path,
+            strerror(errno));
+    seek_cache_close(c);
+    return NULL;
+  }
+  c->end = (off_t)sizeof(h);
+  return c;
+}
+
+// an unlinked file in TMPDIR, gone with the process
+static int temp_file(void) {
+  const char *dir = getenv("TMPDIR");
+  char path[4096];
+  if (snprintf(path, sizeof(path), "%s/ddpctl-seek-XXXXXX",
+               dir && *dir ? dir : "/tmp") >= (int)sizeof(path))
+    return -1;
+
+  int fd = mkstemp(path);
+  if (fd < 0)
+    return -1;
+  unlink(path);
+  return fd;
+}
+
+struct seek_cache *seek_cache_shared(const char *gif, size_t canvas_size,
+                                     uint64_t points_hash, size_t frame_count,
+                                     size_t interval, int on_disk) {
+  struct seek_cache *c =
+      cache_new(gif, canvas_size, points_hash, frame_count, interval);
+  if (!c)
+    return NULL;
+
+  pthread_mutex_lock(&g_shared_lock);
+  for (struct seek_cache *o = g_shared; o; o = o->next) {
+    if (memcmp(&o->id, &c->id, sizeof(c->id)) == 0) {
+      pthread_mutex_unlock(&g_shared_lock);
+      seek_cache_close(c);
+      return o;
+    }
+  }
+
+  // a file starts with its header, so no record is at offset 0
+  if (on_disk) {
+    c->fd = temp_file();
+    c->end = (off_t)sizeof(c->id);
+    c->path = "(temporary)";
+  } else {
+    size_t nkeys = (frame_count + interval - 1) / interval;
+    c->mem = (uint8_t **)calloc(nkeys, sizeof(*c->mem));
+  }
+  if (on_disk ? c->fd < 0 : !c->mem) {
+    pthread_mutex_unlock(&g_shared_lock);
+    seek_cache_close(c);
+    return NULL;
+  }
+
+  c->shared = 1;
+  c->next = g_shared;
+  g_shared = c;
+  pthread_mutex_unlock(&g_shared_lock);
+  return c;
+}
+
+static uint8_t *find_locked(struct seek_cache *c, size_t n, size_t *frame) {
+  if (n >= c->frame_count)
+    return NULL;
+
+  for (size_t k = n / c->interval + 1; k-- > 0;) {
+    if (c->mem ? !c->mem[k] : !c->at[k])
+      continue;
+
+    uint8_t *canvas = (uint8_t *)malloc(c->canvas_size);
+    if (!canvas)
+      return NULL;
+    if (c->mem) {
+      memcpy(canvas, c->mem[k], c->canvas_size);
+    } else if (pread(c->fd, canvas, c->canvas_size, c->at[k]) !=
+               (ssize_t)c->canvas_size) {
+      free(canvas);
+      return NULL;
+    }
+
+    *frame = k * c->interval;
+    return canvas;
+  }
+
+  return NULL;
+}
+
+uint8_t *seek_cache_find(struct seek_cache *c, size_t n, size_t *frame) {
+  pthread_mutex_lock(&c->lock);
+  uint8_t *canvas = find_locked(c, n, frame);
+  pthread_mutex_unlock(&c->lock);
+  return canvas;
+}
+
+static void put_locked(struct seek_cache *c, size_t k,
+                       const uint8_t *canvas) {
+  if (c->failed || k >= c->frame_count || k % c->interval != 0 ||
+      (c->mem ? c->mem[k / c->interval] != NULL : c->at[k / c->interval]))
+    return;
+
+  if (c->mem) {
+    uint8_t *copy = (uint8_t *)malloc(c->canvas_size);
+    if (copy)
+      memcpy(copy, canvas, c->canvas_size);
+    c->mem[k / c->interval] = copy;
+    return;
+  }
+
+  uint64_t frame = k;
+  off_t data = c->end + (off_t)sizeof(frame);
+  if (pwrite(c->fd, &frame, sizeof(frame), c->end) !=
+          (ssize_t)sizeof(frame) ||
+      pwrite(c->fd, canvas, c->canvas_size, data) !=
+          (ssize_t)c->canvas_size) {
+    // a partial record is cut off the next time the file is opened
+    fprintf(stderr, "failed to write seek cache %s: %s\n", c->path,
+            strerror(errno));
+    c->failed = 1;
+    return;
+  }
+
+  c->at[k / c->interval] = data;
+  c->end = data + (off_t)c->canvas_size;
+}
+
+void seek_cache_put(struct seek_cache *c, size_t k, const uint8_t *canvas) {
+  pthread_mutex_lock(&c->lock);
+  put_locked(c, k, canvas);
+  pthread_mutex_unlock(&c->lock);
+}
+
+void seek_cache_close(struct seek_cache *c) {
+  if (!c || c->shared)
+    return;
+
+  if (c->fd >= 0)
+    close(c->fd);
+  pthread_mutex_destroy(&c->lock);
+  free(c->at);
+  free(c);
+}
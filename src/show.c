@@ -0,0 +1,200 @@
+#include "../include/show.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../include/clock.h"
+#include "../include/output.h"
+
+#define SHOW_VERSION 1
+#define SHOW_ALIGN 8
+
+struct show_writer {
+  FILE *fp;
+  uint64_t start;
+  int failed;
+};
+
+static size_t padding(size_t len) {
+  return (SHOW_ALIGN - len % SHOW_ALIGN) % SHOW_ALIGN;
+}
+
+static void write_record(struct show_writer *w, uint8_t type, uint16_t sink,
+                         const struct iovec *iov, int iovcnt) {
+  struct show_record rec = {0};
+  rec.t_ns = mono_ns() - w->start;
+  rec.sink = sink;
+  rec.type = type;
+  for (int i = 0; i < iovcnt; i++)
+    rec.len += (uint32_t)iov[i].iov_len;
+
+  static const uint8_t zeros[SHOW_ALIGN] = {0};
+
+  // stdio buffers this, so the send loop only pays for a memcpy
+  int ok = fwrite(&rec, sizeof(rec), 1, w->fp) == 1;
+  for (int i = 0; i < iovcnt; i++)
+    ok = ok && fwrite(iov[i].iov_base, 1, iov[i].iov_len, w->fp) ==
+                   iov[i].iov_len;
+  size_t pad = padding(rec.len);
+  ok = ok && fwrite(zeros, 1, pad, w->fp) == pad;
+
+  if (!ok && !w->failed) {
+    fprintf(stderr, "failed to write show file: %s\n", strerror(errno));
+    w->failed = 1;
+  }
+}
+
+struct show_writer *show_open(const char *path) {
+  struct show_writer *w = (struct show_writer *)calloc(1, sizeof(*w));
+  if (!w)
+    return NULL;
+
+  w->fp = fopen(path, "wb");
+  if (!w->fp) {
+    fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+    free(w);
+    return NULL;
+  }
+  setvbuf(w->fp, NULL, _IOFBF, 1 << 16);
+
+  struct show_header h = {.version = SHOW_VERSION};
+  memcpy(h.magic, SHOW_MAGIC, sizeof(h.magic));
+  fwrite(&h, sizeof(h), 1, w->fp);
+
+  w->start = mono_ns();
+  return w;
+}
+
+void show_declare_sink(struct show_writer *w, uint16_t sink,
+                       const char *spec) {
+  struct iovec iov = {.iov_base = (void *)spec, .iov_len = strlen(spec)};
+  write_record(w, SHOW_SINK, sink, &iov, 1);
+}
+
+void show_write_packet(struct show_writer *w, uint16_t sink,
+                       const struct iovec *iov, int iovcnt) {
+  write_record(w, SHOW_PACKET, sink, iov, iovcnt);
+}
+
+int show_close(struct show_writer *w) {
+  if (!w)
+    return 0;
+
+  write_record(w, SHOW_END, 0, NULL, 0);
+  int ret = fclose(w->fp) == 0 && !w->failed ? 0 : -1;
+  free(w);
+  return ret;
+}
+
+static void sleep_until(uint64_t t) {
+  struct timespec ts = {.tv_sec = (time_t)(t / NS_PER_SEC),
+                        .tv_nsec = (long)(t % NS_PER_SEC)};
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+}
+
+int show_replay(const char *path, const char *output, int loop_count) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct show_header)) {
+    fprintf(stderr, "not a show file: %s\n", path);
+    close(fd);
+    return -1;
+  }
+
+  size_t size = (size_t)st.st_size;
+  const uint8_t *base =
+      (const uint8_t *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    fprintf(stderr, "failed to map %s: %s\n", path, strerror(errno));
+    return -1;
+  }
+  madvise((void *)base, size, MADV_SEQUENTIAL);
+
+  const struct show_header *h = (const struct show_header *)base;
+  if (memcmp(h->magic, SHOW_MAGIC, sizeof(h->magic)) != 0 ||
+      h->version != SHOW_VERSION) {
+    fprintf(stderr, "not a show file: %s\n", path);
+    munmap((void *)base, size);
+    return -1;
+  }
+
+  // the default 50us timer slack would show up as jitter
+  prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+
+  struct sink **sinks = (struct sink **)calloc(UINT16_MAX + 1, sizeof(*sinks));
+  struct sink *override = output ? sink_open(output) : NULL;
+  int ret = !sinks || (output && !override) ? -1 : 0;
+
+  uint64_t loop_start = mono_ns();
+  for (int loop = 0; ret == 0 && (loop_count < 0 || loop < loop_count);
+       loop++) {
+    size_t pos = sizeof(*h);
+    uint64_t end = 0;
+
+    while (ret == 0 && pos + sizeof(struct show_record) <= size) {
+      const struct show_record *rec = (const struct show_record *)(base + pos);
+      const uint8_t *payload = base + pos + sizeof(*rec);
+      pos += sizeof(*rec) + rec->len + padding(rec->len);
+      if (pos > size) {
+        fprintf(stderr, "truncated show file: %s\n", path);
+        ret = -1;
+        break;
+      }
+
+      if (rec->type == SHOW_END) {
+        end = rec->t_ns;
+        break;
+      }
+
+      if (rec->type == SHOW_SINK) {
+        if (!override && !sinks[rec->sink]) {
+          char spec[512];
+          snprintf(spec, sizeof(spec), "%.*s", (int)rec->len,
+                   (const char *)payload);
+          sinks[rec->sink] = sink_open(spec);
+          if (!sinks[rec->sink])
+            ret = -1;
+        }
+        continue;
+      }
+
+      struct sink *s = override ? override : sinks[rec->sink];
+      if (rec->type != SHOW_PACKET || !s)
+        continue;
+
+      // every packet, each fragment included, goes out at the offset into
+      // the show it was recorded at
+      sleep_until(loop_start + rec->t_ns);
+      if (sink_write(s, payload, rec->len) != 0)
+        ret = -1;
+      end = rec->t_ns;
+    }
+
+    // an empty show would spin
+    if (end == 0)
+      break;
+    loop_start += end;
+  }
+
+  for (size_t i = 0; sinks && i <= UINT16_MAX; i++)
+    sink_close(sinks[i]);
+  free(sinks);
+  sink_close(override);
+  munmap((void *)base, size);
+  return ret;
+}
@@ -0,0 +1,114 @@
+#include "../include/wall.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int add_region(struct wall *w, const struct wall_region *r) {
+  struct wall_region *regions = (struct wall_region *)realloc(
+      w->regions, (w->count + 1) * sizeof(*regions));
+  if (!regions)
+    return -1;
+
+  w->regions = regions;
+  struct wall_region *added = &w->regions[w->count];
+  *added = *r;
+  added->output = strdup(r->output);
+  added->layout = r->layout ? strdup(r->layout) : NULL;
+  if (!added->output || (r->layout && !added->layout)) {
+    free(added->output);
+    free(added->layout);
+    return -1;
+  }
+
+  w->count += 1;
+  return 0;
+}
+
+struct wall *wall_load(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    fprintf(stderr, "failed to open layout %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+
+  struct wall *w = (struct wall *)calloc(1, sizeof(*w));
+  if (!w) {
+    fclose(fp);
+    return NULL;
+  }
+
+  char line[1024];
+  int line_no = 0;
+  int ok = 1;
+
+  while (ok && fgets(line, sizeof(line), fp)) {
+    line_no += 1;
+
+    char *p = line;
+    while (isspace((unsigned char)*p))
+      p++;
+    if (*p == '\0' || *p == '#')
+      continue;
+
+    if (strncmp(p, "wall", 4) == 0 && isspace((unsigned char)p[4])) {
+      ok = sscanf(p + 4, "%d %d", &w->width, &w->height) == 2 &&
+           w->width > 0 && w->height > 0;
+    } else if (strncmp(p, "controller", 10) == 0 &&
+               isspace((unsigned char)p[10])) {
+      char output[512], layout[512];
+      struct wall_region r = {.output = output};
+      unsigned long offset = 0;
+
+      int n = sscanf(p + 10, "%511s %d %d %d %d %lu %511s", output, &r.x,
+                     &r.y, &r.w, &r.h, &offset, layout);
+      r.offset = (uint32_t)offset;
+      if (n == 7)
+        r.layout = layout;
+
+      // regions must lie inside a wall declared above them
+      ok = n >= 5 && offset <= UINT32_MAX && w->width > 0 && r.x >= 0 &&
+           r.y >= 0 && r.w > 0 && r.h > 0 && r.x + r.w <= w->width &&
+           r.y + r.h <= w->height;
+      if (ok && add_region(w, &r) != 0) {
+        fprintf(stderr, "out of memory reading layout\n");
+        wall_free(w);
+        fclose(fp);
+        return NULL;
+      }
+    } else {
+      ok = 0;
+    }
+
+    if (!ok)
+      fprintf(stderr, "%s:%d: invalid layout line: %s", path, line_no, line);
+  }
+
+  fclose(fp);
+
+  if (ok && w->count == 0) {
+    fprintf(stderr, "%s: layout has no controllers\n", path);
+    ok = 0;
+  }
+
+  if (!ok) {
+    wall_free(w);
+    return NULL;
+  }
+
+  return w;
+}
+
+void wall_free(struct wall *w) {
+  if (!w)
+    return;
+
+  for (size_t i = 0; i < w->count; i++) {
+    free(w->regions[i].output);
+    free(w->regions[i].layout);
+  }
+  free(w->regions);
+  free(w);
+}